@@ -5,8 +5,55 @@
 #include <stddef.h>
 
 
+#define ATA_SECTOR_SIZE  512
+#define ATA_MAX_SECTORS  256   // per command; also the size of the DMA bounce buffer
+
+#define ATA_MAX_DRIVES   4     // master/slave on the two legacy channels
+
+// One IDENTIFY'd ATA disk. Disks are numbered in probe order: primary
+// master, primary slave, secondary master, secondary slave, skipping
+// empty or ATAPI positions.
+typedef struct {
+    uint8_t  present;
+    uint8_t  channel;        // 0 primary, 1 secondary
+    uint8_t  slave;
+    uint8_t  lba48;
+    uint8_t  dma;            // bus-master DMA in use
+    uint8_t  xfer_mode;      // SET FEATURES value: 0x40|n UDMA, 0x20|n MWDMA, 0x08|n PIO
+    uint16_t multi;          // sectors per DRQ block for READ MULTIPLE
+    uint64_t sectors;        // capacity
+    char     model[41];
+} AtaDrive;
+
+void ata_init(void);
+
+int ata_drive_count(void);
+
+const AtaDrive* ata_drive(int idx);
+
+// IRQ14/IRQ15 entry from isr_handler; channel 0 = primary, 1 = secondary
+void ata_irq(int channel);
+
 void ata_read_sector(uint32_t lba, uint8_t* buffer);
 
+// Read count sectors starting at lba from disk 'drive', split into commands
+// of at most ATA_MAX_SECTORS. LBA48 commands are used once the range passes
+// the 28-bit limit. Returns 0 on success, -1 on a drive error or timeout.
+int ata_read(int drive, uint64_t lba, uint32_t count, uint8_t* buffer);
+
+// Write counterpart of ata_read: WRITE DMA when the drive uses DMA,
+// otherwise WRITE MULTIPLE / WRITE SECTORS. Data may sit in the drive's
+// cache until ata_flush.
+int ata_write(int drive, uint64_t lba, uint32_t count, const uint8_t* buffer);
+
+// FLUSH CACHE (EXT): returns once the drive has committed its write cache.
+int ata_flush(int drive);
+
+// ata_read/ata_write on disk 0, the boot filesystem
+int ata_read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer);
+
+int ata_write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer);
+
 int dump_mem(uint8_t* buffer, size_t length);
 
 void cmd_dump_sector(int lba);
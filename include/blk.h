@@ -0,0 +1,108 @@
+//blk.h
+#ifndef BLK_H
+#define BLK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "blkdev.h"
+
+// Block request layer between the filesystem and a block device.
+// Callers submit reads; blk_run() dispatches them in elevator (C-SCAN)
+// order, merging requests whose LBAs are adjacent or overlap into one
+// multi-sector command, and calls each request's callback as it completes.
+// Requests fully covered by the LRU sector cache never reach the disk.
+
+#define BLK_PENDING 1   // status while queued; 0 = done, -1 = I/O error
+
+#define BLK_SECTOR_SIZE 512
+#define BLK_MAX_SECTORS 256   // largest merged command; also the merge buffer size
+
+// Sector cache budget, taken from the frame allocator on first use.
+// Must be a power of two; build with -DBLK_CACHE_KB=... to change it.
+#ifndef BLK_CACHE_KB
+#define BLK_CACHE_KB 1024
+#endif
+
+typedef struct {
+    uint64_t hits;           // sectors served from cache
+    uint64_t misses;         // sectors read from disk on demand
+    uint64_t readahead;      // sectors read from disk by blk_prefetch
+    uint64_t commands;       // disk read commands issued
+    uint32_t cached;         // sectors currently cached
+    uint32_t capacity;       // cache size in sectors
+} BlkStats;
+
+typedef struct BlkRequest BlkRequest;
+
+typedef void (*blk_done_fn)(BlkRequest *req, int status);
+
+struct BlkRequest {
+    uint64_t lba;
+    uint32_t count;          // sectors
+    uint8_t *buf;            // count * 512 bytes
+    blk_done_fn done;        // may be NULL; may resubmit or free req
+    void *ctx;               // caller data for done
+    volatile int status;
+    BlkRequest *next;        // queue link, sorted by lba
+};
+
+// Queue a read. The request must stay valid until its callback runs.
+void blk_submit(BlkRequest *req);
+
+// Deliver pending cache hits or, if there are none, dispatch one command's
+// worth of the queue. Returns 0 once there was nothing left to do.
+int blk_step(void);
+
+// Dispatch everything queued, including anything callbacks submit.
+void blk_run(void);
+
+// Submit and wait for one read. Returns 0 on success, -1 on error.
+int blk_read(uint64_t lba, uint32_t count, uint8_t *buf);
+
+// Queue a cache-only read of the uncached part of [lba, lba+count).
+// It goes out with whatever the queue dispatches next, merged with any
+// demand reads next to it, or from the idle loop if nothing else runs.
+// Returns how many sectors from 'lba' on are now cached or queued; fewer
+// than 'count' once the staging area is out of room.
+uint32_t blk_prefetch(uint64_t lba, uint32_t count);
+
+// Write-back buffering: blk_write copies into a dirty-sector pool and
+// returns. Reads see the buffered data. blk_sync (or blk_idle once the
+// oldest dirty sector is BLK_WRITEBACK_MS old) writes adjacent sectors
+// out as single commands and then flushes the device's write cache.
+#define BLK_DIRTY_MAX      256     // sectors buffered before a forced writeback
+#define BLK_WRITEBACK_MS   5000
+
+int blk_write(uint64_t lba, uint32_t count, const uint8_t *buf);
+
+// Bumped by every blk_write; caches of parsed on-disk structures compare
+// it to tell whether they may be stale.
+uint32_t blk_write_generation(void);
+
+int blk_sync(void);
+
+// Whether blk_idle has anything to do: queued reads or dirty sectors.
+int blk_busy(void);
+
+// Idle-loop hook: dispatch queued reads and run timed writeback.
+void blk_idle(void);
+
+void blk_stats(BlkStats *out);
+
+// Route all block I/O to 'dev'. Pending reads and dirty sectors are
+// finished on the old device first and the sector cache is emptied.
+// Fails for devices whose sector size isn't BLK_SECTOR_SIZE.
+int blk_attach(BlkDev *dev);
+
+BlkDev *blk_device(void);
+
+// Boot-time check that read-ahead reaches the disk and merges with the
+// reads it runs ahead of. Built with -DBLK_SELFTEST=1; halts on failure.
+#ifndef BLK_SELFTEST
+#define BLK_SELFTEST 0
+#endif
+#if BLK_SELFTEST
+void blk_selftest(void);
+#endif
+
+#endif
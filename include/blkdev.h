@@ -0,0 +1,50 @@
+//blkdev.h
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Block device interface. Each backend (ATA disks, RAM disks) fills in a
+// BlkDev and registers it; everything above, from the block request layer
+// to the filesystem, reads and writes through the ops and never talks to
+// a driver directly. Devices are registered once and never removed.
+
+#define BLKDEV_MAX 8
+
+typedef struct BlkDev BlkDev;
+
+typedef struct {
+    int (*read)(BlkDev *dev, uint64_t lba, uint32_t count, uint8_t *buf);
+    int (*write)(BlkDev *dev, uint64_t lba, uint32_t count, const uint8_t *buf);
+    int (*flush)(BlkDev *dev);   // NULL when writes are durable on return
+} BlkDevOps;
+
+struct BlkDev {
+    char name[8];                // "hd0", "ram0", ...
+    const BlkDevOps *ops;
+    uint32_t sector_size;
+    uint64_t sectors;            // capacity
+    void *priv;                  // backend data
+};
+
+// Returns the device's index, or -1 when the table is full
+int blkdev_register(BlkDev *dev);
+
+int blkdev_count(void);
+
+BlkDev *blkdev_get(int idx);
+
+BlkDev *blkdev_find(const char *name);
+
+// Range-checked calls through the ops. 0 on success, -1 on error.
+int blkdev_read(BlkDev *dev, uint64_t lba, uint32_t count, uint8_t *buf);
+
+int blkdev_write(BlkDev *dev, uint64_t lba, uint32_t count, const uint8_t *buf);
+
+int blkdev_flush(BlkDev *dev);
+
+// Fill dev->name with prefix followed by a decimal index
+void blkdev_name(BlkDev *dev, const char *prefix, int idx);
+
+#endif
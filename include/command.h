@@ -1,6 +1,7 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#include "mem.h"
 
 typedef struct {
     char **argv;               // Command and arguments
@@ -22,8 +23,6 @@ typedef struct {
     //char *raw_input;           // Original input string (for debugging/logging)
 } Command;
 
-void free_command(Command *cmd);
-
-void free_command_list(Command **cmds, int num_cmds);
+Command *command_new(Arena *arena, int max_args);
 
 #endif
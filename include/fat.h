@@ -2,6 +2,7 @@
 #define FAT_H
 
 #include "types.h"
+#include "blkdev.h"
 //#include "shell.h"
 
 typedef struct ShellContext ShellContext;
@@ -12,7 +13,9 @@ typedef struct {
     uint16_t reserved_sectors;
     uint8_t  num_fats;
     uint16_t root_entry_count;
-    uint16_t sectors_per_fat;
+    uint32_t sectors_per_fat;
+    uint32_t root_cluster;   // FAT32 only: first cluster of the root directory
+    uint32_t total_sectors;
     uint32_t root_start_lba;
     uint32_t data_start_lba;
 } fat_bpb;
@@ -25,37 +28,118 @@ enum FATType {
 };
 
 
+// Decoded FAT entry for the last cluster of a chain (and anything else
+// that doesn't link to a valid data cluster)
+#define FAT_EOC 0x0FFFFFFF
+
+// A mounted volume with its FAT held in memory, one entry per cluster
 typedef struct {
     enum FATType type;
     fat_bpb bpb;
-    // maybe add root_cluster for FAT32
+    BlkDev *dev;             // device it was mounted from
+    uint32_t clusters;       // data clusters, numbered 2..clusters+1
+    uint32_t *fat;           // next cluster for each cluster, or FAT_EOC
+    size_t fat_frames;
 } fat_fs;
 
+static inline int fat_valid_cluster(const fat_fs *fs, uint32_t cluster) {
+    return cluster >= 2 && cluster < fs->clusters + 2;
+}
+
+static inline uint32_t fat_cluster_lba(const fat_fs *fs, uint32_t cluster) {
+    // Data region starts at data_start_lba, and cluster #2 is the first data cluster.
+    return fs->bpb.data_start_lba + (cluster - 2) * fs->bpb.sectors_per_cluster;
+}
+
+
+#define FAT_ATTR_DIR 0x10
+
+// Longest long file name in UTF-8, terminator included
+#define FAT_NAME_MAX 256
 
 typedef struct {
     char name[9]; // null-terminated
     char ext[4];  // null-terminated
+    char full[13]; // "NAME.EXT", or "NAME" without an extension
     uint8_t attr;
-    uint16_t first_cluster;
+    uint32_t first_cluster;
     uint32_t size;
 } fat_dir_entry;
 
+// An open file: a read cursor over its cluster chain. Reads that pick up
+// where the previous one stopped count as streaming; each one queues
+// read-ahead past its end and grows the number of clusters prefetched.
+// Any other read goes back to the smallest window.
+#define FAT_RA_MIN 4      // clusters
+#define FAT_RA_MAX 64
+
+// A run of physically consecutive clusters in a chain
+typedef struct {
+    uint32_t start;          // first cluster
+    uint32_t len;            // clusters
+} fat_extent;
+
+typedef struct {
+    fat_fs *fs;
+    fat_extent *extents;     // the file's cluster chain, run by run
+    uint32_t nextents;
+    uint32_t size;
+    uint32_t pos;            // byte offset of the next read
+    uint32_t ext;            // extent holding pos, nextents past the end
+    uint32_t ext_index;      // chain index of that extent's first cluster
+    uint32_t next_pos;       // where the previous read ended
+    uint32_t ra_end;         // file sector read-ahead has reached
+    uint32_t ra_window;      // clusters to keep prefetched
+} fat_file;
+
 int fs_parse_boot_sector(fat_bpb* bpb);
 
 int parse_dir_entry(const uint8_t* e, fat_dir_entry* out);
 
-int find_root_entry(const fat_bpb* bpb, const char* name83, fat_dir_entry* out);
+// Look 'name', short or long, up in the directory starting at cluster 'dir'
+// (0 for the FAT12/16 root), case-insensitively, through the directory cache
+int fat_dir_lookup(const fat_fs* fs, uint32_t dir, const char* name, fat_dir_entry* out);
 
-uint16_t fat12_get_next_cluster(uint16_t cluster, const fat_bpb* bpb);
+// Longest canonical path, terminator included
+#define FAT_PATH_MAX 512
 
-int fs_read_file(const char* name83, uint8_t* out, size_t maxlen);
+// Canonical form of 'path' taken relative to 'cwd' (itself canonical):
+// absolute, no "." or ".." or repeated slashes. -1 if too long.
+int fat_path_join(const char* cwd, const char* path, char out[FAT_PATH_MAX]);
 
-int print_file(char *filename, ShellContext *shell);
+// Look up the entry 'path' names relative to 'cwd' on the mounted volume.
+// The root comes back as a directory entry with no name.
+int fat_resolve(const char* cwd, const char* path, fat_dir_entry* out);
 
-int fs_list_files(ShellContext *shell);
+// Change the shell's current directory
+int fat_chdir(ShellContext* shell, const char* path);
 
-int list_root(const fat_bpb* bpb, fat_dir_entry* out, ShellContext *shell);
+int fat_list_dir(const char* cwd, const char* path, ShellContext *shell);
+
+// Mount the block layer's current device: parse the BPB, load the FAT
+int fat_mount(fat_fs* fs);
+
+void fat_unmount(fat_fs* fs);
+
+// The mounted volume, mounting (or remounting after a device change) first
+fat_fs* fat_volume(void);
+
+uint32_t fat_next_cluster(const fat_fs* fs, uint32_t cluster);
+
+// Open the file at 'path'; relative paths start at the root
+int fat_open(const char* path, fat_file* f);
+
+int fat_read(fat_file* f, uint8_t* out, size_t len);
+
+void fat_close(fat_file* f);
+
+void fat_seek(fat_file* f, uint32_t pos);
+
+int fs_read_file(const char* path, uint8_t* out, size_t maxlen);
+
+int print_file(char *filename, ShellContext *shell);
 
-int list_dir_entry(const uint8_t* e, fat_dir_entry* out, ShellContext *shell);
+// List a directory, the current one when 'path' is NULL
+int fs_list_files(ShellContext *shell, const char* path);
 
 #endif
\ No newline at end of file
@@ -53,6 +53,22 @@ void remap_pic(void);
 
 void enable_irq(void);
 
+void irq_unmask(uint8_t irq);
+
+void irq_eoi(uint8_t irq);
+
+// PIT channel 0 drives irq0; ticks count from pit_init. Kept low: every
+// tick wakes the idle loop, and timeouts only need 10 ms resolution.
+#define TIMER_HZ 100
+
+void pit_init(uint32_t hz);
+
+uint64_t timer_ticks(void);
+
+static inline uint64_t ms_to_ticks(uint32_t ms) {
+    return ((uint64_t)ms * TIMER_HZ + 999) / 1000;
+}
+
 void irq0_handler(isr_frame_t *f);
 
 void irq1_handler(isr_frame_t *f);
@@ -104,4 +120,15 @@ extern void isr33();
 extern void isr34();
 extern void isr35();
 extern void isr36();
+extern void isr37();
+extern void isr38();
+extern void isr39();
+extern void isr40();
+extern void isr41();
+extern void isr42();
+extern void isr43();
+extern void isr44();
+extern void isr45();
+extern void isr46();
+extern void isr47();
 #endif
\ No newline at end of file
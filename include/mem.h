@@ -5,32 +5,153 @@
 #include <stddef.h> 
 #include "multiboot.h"
 
+#define PAGE_SIZE 4096
 
+// Per-call-site heap profiling, off by default. Debug builds turn it on
+// with -DMEM_PROFILE=1; every allocation then carries a 16-byte AllocTag
+// naming its caller, which can push it up a size class.
+#ifndef MEM_PROFILE
+#define MEM_PROFILE 0
+#endif
+#define MEM_PROFILE_SITES 128
 
+// Small allocations are served from power-of-two size classes (16..2048 bytes).
+// Each slab is SLAB_PAGES whole pages, aligned to its own size, so the owning
+// slab header of any object is found by masking the pointer.
+#define SLAB_MIN_SHIFT 4   // 16 bytes
+#define SLAB_MAX_SHIFT 11  // 2048 bytes
+#define SLAB_CLASSES   (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+#define SLAB_PAGES     4
+#define SLAB_SIZE      (SLAB_PAGES * PAGE_SIZE)
+#define SLAB_MAX_OBJ   (1 << SLAB_MAX_SHIFT)
+
+typedef struct SlabObj {
+    struct SlabObj *next;
+} SlabObj;
+
+typedef struct Slab {
+    struct Slab *next;  // next slab in the class partial list (or free slab list)
+    struct Slab *prev;
+    SlabObj *free;      // freed objects ready for reuse
+    uint8_t *bump;      // first never-used object
+    uint32_t in_use;
+    uint32_t capacity;
+    uint32_t cls;       // size class index
+} Slab;
+
+// Physical frames are handed out by a binary buddy allocator, order 0 (4 KiB)
+// through BUDDY_MAX_ORDER (2 MiB, one PAGE_PS mapping).
+#define BUDDY_MAX_ORDER 9
+
+// List node stored in the first bytes of a free buddy block
+typedef struct FrameBlock {
+    struct FrameBlock *next;
+    struct FrameBlock *prev;
+    uint32_t order;
+} FrameBlock;
+
+// Boundary-tagged heap block. Every block starts with prev_size/size, so both
+// physical neighbours are reachable in O(1). The free-list links overlay the
+// payload and are only valid while the block is free.
 typedef struct Chunk {
-    size_t size;
-    int is_free;
-    struct Chunk *next;
+    size_t prev_size;         // payload bytes of the block physically below
+    size_t size;              // payload bytes of this block, CHUNK_USED in bit 0
+    struct Chunk *next_free;
+    struct Chunk *prev_free;
 } Chunk;
 
+#define CHUNK_USED      ((size_t)1)
+#define CHUNK_HDR_SIZE  offsetof(Chunk, next_free)  // 16, keeps payloads 16-byte aligned
+#define CHUNK_MIN_SIZE  (sizeof(Chunk) - CHUNK_HDR_SIZE)
+
 void mem_init();
 
 void add_region(uint64_t base, uint64_t length);
 
-void init_allocator(const struct multiboot_tag_mmap* mmap); 
+void reserve_region(uint64_t base, uint64_t length);
+
+void init_allocator(const struct multiboot_tag_mmap* mmap, const void* mb_info);
 
 uint64_t alloc_frame();
 
+uint64_t alloc_frames(size_t count);
+
+uint64_t alloc_frames_aligned(size_t count, size_t align);
+
 void free_frame(uint64_t addr);
 
+void free_frames(uint64_t addr, size_t count);
+
+uint64_t buddy_alloc(uint32_t order);
+
+void buddy_free(uint64_t addr, uint32_t order);
+
+uint64_t alloc_huge_frame();
+
+void free_huge_frame(uint64_t addr);
+
+// Bump-pointer arena for short-lived allocations that all die together
+// (e.g. everything the parser builds for one command line).
+#define ARENA_BLOCK_SIZE 4096
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;        // usable bytes after the header
+    size_t used;
+    size_t pad;         // keeps the data that follows 16-byte aligned
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *head;   // block currently being bumped; older blocks follow
+} Arena;
+
+typedef struct AllocTag {
+    void *site;         // return address of the thralloc/cralloc/strdupe caller
+    size_t size;        // bytes the caller asked for
+} AllocTag;
+
+typedef struct AllocSite {
+    void *site;
+    size_t live_bytes;  // requested bytes still allocated
+    size_t peak_bytes;
+    size_t slack_bytes; // rounding lost to size classes/chunk headers on live blocks
+    uint32_t allocs;
+    uint32_t frees;
+} AllocSite;
+
 void* thralloc(size_t size);
 
+void* thralloc_at(size_t size, void *site);
+
+typedef struct HeapStats {
+    size_t chunk_bytes;   // chunk payloads plus headers in use
+    size_t slab_bytes;    // slab objects in use
+    size_t heap_frames;   // frames lent to heap regions and slabs
+    size_t free_bytes;    // free chunk payloads
+    size_t free_chunks;
+    size_t largest_free;
+} HeapStats;
+
+int mem_top_sites(AllocSite *out, int max);
+
+void mem_heap_stats(HeapStats *out);
+
 size_t thralloc_total();
 
 void* cralloc(size_t num, size_t size);
 
 void tfree(void *ptr);
 
-void* memset(void* bufptr, int value, size_t size);
+void arena_init(Arena *arena);
+
+void* arena_alloc(Arena *arena, size_t size);
+
+void* arena_calloc(Arena *arena, size_t num, size_t size);
+
+char* arena_strdup(Arena *arena, const char *str);
+
+void arena_reset(Arena *arena);
+
+void arena_destroy(Arena *arena);
 
 #endif
\ No newline at end of file
@@ -26,6 +26,14 @@ struct multiboot_tag_string {
 
 
 
+struct multiboot_tag_module {
+    uint32_t type;      // 3
+    uint32_t size;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];
+};
+
 struct multiboot_mmap_entry {
     uint64_t base_addr;
     uint64_t length;
@@ -4,12 +4,10 @@
 #include "command.h"
 #include "shell.h"
 
-Command **parse_commands(const char *input, int *num_cmds);
+Command **parse_commands(Arena *arena, const char *input, int *num_cmds);
 
-char **split_on_semicolons(const char *input);
+char **split_on_semicolons(Arena *arena, const char *input);
 
 void process_input_segments(ShellContext *shell, const char *expanded_input);
 
-void free_segments(char **segments);
-
 #endif
\ No newline at end of file
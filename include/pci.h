@@ -0,0 +1,58 @@
+//pci.h
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// Legacy configuration mechanism #1 ports
+#define PCI_CONFIG_ADDR   0xCF8
+#define PCI_CONFIG_DATA   0xCFC
+
+// Config space offsets (type 0 header)
+#define PCI_VENDOR_ID     0x00
+#define PCI_DEVICE_ID     0x02
+#define PCI_COMMAND       0x04
+#define PCI_PROG_IF       0x09
+#define PCI_SUBCLASS      0x0A
+#define PCI_CLASS         0x0B
+#define PCI_HEADER_TYPE   0x0E
+#define PCI_BAR0          0x10
+#define PCI_BAR4          0x20
+#define PCI_INTERRUPT_LINE 0x3C
+
+#define PCI_CMD_IO        0x0001
+#define PCI_CMD_MEMORY    0x0002
+#define PCI_CMD_BUS_MASTER 0x0004
+
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE  0x01
+
+typedef struct {
+    uint8_t  bus;
+    uint8_t  dev;
+    uint8_t  fn;
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t  class_code;
+    uint8_t  subclass;
+    uint8_t  prog_if;
+} PciDevice;
+
+uint32_t pci_read32(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off);
+
+uint16_t pci_read16(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off);
+
+uint8_t pci_read8(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off);
+
+void pci_write32(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off, uint32_t val);
+
+void pci_write16(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off, uint16_t val);
+
+// Walk every bus/device/function and return the first match in *out.
+// Returns 1 if found, 0 if not.
+int pci_find_class(uint8_t class_code, uint8_t subclass, PciDevice *out);
+
+// Log every function present on the bus.
+void pci_enumerate(void);
+
+#endif
@@ -0,0 +1,15 @@
+//ramdisk.h
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include "multiboot.h"
+
+#define RAMDISK_MAX 4
+
+// Register a multiboot module as a RAM disk block device ("ram0", ...).
+// The module's memory is already reserved from the frame allocator, so
+// the image is used in place; writes change it until the next boot.
+int ramdisk_add_module(const struct multiboot_tag_module *mod);
+
+#endif
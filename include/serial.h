@@ -26,6 +26,30 @@ void serial_write_hex64(uint64_t v);
 
 void sfprint(const char *str, ...);
 
+// Leveled serial logging. Messages above LOG_LEVEL compile away entirely, so
+// hot paths can log freely without paying for COM1 in normal builds.
+// Pick the level at build time, e.g. make LOG_LEVEL=5 for a trace build.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERR   1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_WARN
+#endif
+
+// LOG(LOG_LEVEL_WARN, "bad thing %d", x); -- prefix and newline are added
+#define LOG(level, fmt, ...)                                   \
+    do {                                                       \
+        if ((level) <= LOG_LEVEL) {                            \
+            log_write((level), fmt, ##__VA_ARGS__);            \
+        }                                                      \
+    } while (0)
+
+void log_write(int level, const char *fmt, ...);
+
 void format_sfprint(const char* str, va_list args);
 
 void u32tohex(uint32_t val, char* buff);
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include "kbd.h"
 #include "types.h"
+#include "mem.h"
+#include "fat.h"
 
 #define INPUT_SIZE 1024
 #define LINEBUFF_SIZE 128
@@ -16,12 +18,13 @@ typedef struct ShellContext {
     int scroll_offset;
     int history_count;
     char** line_history;
+    Arena cmd_arena;          // Scratch for parsing one command line, reset after it runs
+    char cwd[FAT_PATH_MAX];   // Current working directory, a canonical path
     // int  last_status; // Last command exit status
     // int   tty_fd; // Terminal file descriptor
     // pid_t shell_pgid; // Shell process group ID
     // pid_t last_pgid;    // Last foreground process group ID
     // pid_t pipeline_pgid; // Current pipeline process group ID
-    // char cwd[512];            // Current working directory
     // History history; // Command history
     // VarTable *vars; // Hash table for variables
 } ShellContext;
@@ -51,6 +54,12 @@ void scroll_on_newline(ShellContext *shell);
 
 void scroll_on_wrap(ShellContext *shell);
 
+int print_memstat(ShellContext *shell);
+
+int print_blkstat(ShellContext *shell);
+
+int print_disks(ShellContext *shell);
+
 
 // void scroll_history_up(ShellContext *shell);
 
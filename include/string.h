@@ -3,6 +3,7 @@
 #define STRING_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "serial.h"
 
 int cst_strcmp(char *str1, char *str2);
@@ -23,4 +24,16 @@ char *strdupe(const char *str);
 
 int str_eq(const char *a, const char *b);
 
+// Block memory ops. Bulk paths use rep movsb/stosb when the CPU has ERMS,
+// otherwise SSE2 16-byte moves; string_init() picks via CPUID.
+void string_init(void);
+
+void* memcpy(void* dest, const void* src, size_t n);
+
+void* memmove(void* dest, const void* src, size_t n);
+
+void* memset(void* bufptr, int value, size_t size);
+
+int memcmp(const void* a, const void* b, size_t n);
+
 #endif
\ No newline at end of file
@@ -2,7 +2,9 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#ifndef NULL
 #define NULL (void*)0
+#endif
 
 typedef unsigned long size_t;
 
@@ -1,23 +1,78 @@
 #include "ata.h" 
 #include "serial.h"
 #include "string.h"
+#include "mem.h"
+#include "pci.h"
+#include "idt.h"
+#include "blkdev.h"
 
 
 #define ATA_PRIMARY_IO     0x1F0
 #define ATA_PRIMARY_CTRL   0x3F6
+#define ATA_SECONDARY_IO   0x170
+#define ATA_SECONDARY_CTRL 0x376
+#define ATA_PRIMARY_IRQ    14
+#define ATA_SECONDARY_IRQ  15
 
-#define ATA_REG_DATA       0x1F0
-#define ATA_REG_ERROR      0x1F1
-#define ATA_REG_FEATURES   0x1F1
-#define ATA_REG_SECCOUNT0  0x1F2
-#define ATA_REG_LBA0       0x1F3
-#define ATA_REG_LBA1       0x1F4
-#define ATA_REG_LBA2       0x1F5
-#define ATA_REG_HDDEVSEL   0x1F6
-#define ATA_REG_COMMAND    0x1F7
-#define ATA_REG_STATUS     0x1F7
+// Real-time limits, in milliseconds of PIT ticks
+#define ATA_TIMEOUT_MS       5000
+#define ATA_PROBE_TIMEOUT_MS 1000
+#define ATA_FLUSH_TIMEOUT_MS 30000   // the spec allows FLUSH CACHE up to 30 s
+
+// Register offsets from the channel's I/O base
+#define ATA_REG_DATA       0x00
+#define ATA_REG_ERROR      0x01
+#define ATA_REG_FEATURES   0x01
+#define ATA_REG_SECCOUNT0  0x02
+#define ATA_REG_LBA0       0x03
+#define ATA_REG_LBA1       0x04
+#define ATA_REG_LBA2       0x05
+#define ATA_REG_HDDEVSEL   0x06
+#define ATA_REG_COMMAND    0x07
+#define ATA_REG_STATUS     0x07
+
+#define ATA_CTRL_NIEN      0x02
 
 #define ATA_CMD_READ_PIO   0x20
+#define ATA_CMD_READ_PIO_EXT  0x24
+#define ATA_CMD_READ_DMA_EXT  0x25
+#define ATA_CMD_READ_MULTIPLE_EXT 0x29
+#define ATA_CMD_WRITE_PIO  0x30
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_READ_MULTIPLE 0xC4
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_SET_MULTIPLE  0xC6
+#define ATA_CMD_READ_DMA   0xC8
+#define ATA_CMD_WRITE_DMA  0xCA
+#define ATA_CMD_FLUSH_CACHE 0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT 0xEA
+#define ATA_CMD_IDENTIFY   0xEC
+#define ATA_CMD_SET_FEATURES 0xEF
+
+#define ATA_FEAT_XFER_MODE 0x03
+#define ATA_XFER_PIO_FC    0x08   // | mode: PIO flow control mode n
+#define ATA_XFER_MWDMA     0x20   // | mode
+#define ATA_XFER_UDMA      0x40   // | mode
+
+#define ATA_LBA28_LIMIT    (1ULL << 28)
+
+// Bus-master IDE registers, offsets from BAR4 (+8 for the secondary channel)
+#define BM_REG_CMD         0x00
+#define BM_REG_STATUS      0x02
+#define BM_REG_PRDT        0x04
+
+#define BM_CMD_START       0x01
+#define BM_CMD_READ        0x08   // direction: device -> memory
+#define BM_STATUS_ACTIVE   0x01
+#define BM_STATUS_ERR      0x02
+#define BM_STATUS_IRQ      0x04
+
+#define PRD_EOT            0x8000
+#define PRD_MAX_BYTES      0x10000
+#define ATA_DMA_BYTES      (ATA_MAX_SECTORS * ATA_SECTOR_SIZE)
+#define ATA_DMA_FRAMES     (ATA_DMA_BYTES / PAGE_SIZE)
 
 #define ATA_STATUS_ERR     0x01
 #define ATA_STATUS_DRQ     0x08
@@ -27,6 +82,24 @@
 #define ATA_STATUS_BSY     0x80
 #define root_dir_sectors 14 
 #define root_start_lba 19
+
+typedef struct {
+    uint16_t io;
+    uint16_t ctrl;
+    uint16_t bm;            // bus-master base, 0 if no DMA
+    uint8_t  irq;
+    int8_t   selected;      // drive currently in HDDEVSEL, -1 unknown
+    volatile uint8_t irq_pending;
+} AtaChannel;
+
+static AtaChannel channels[2] = {
+    { ATA_PRIMARY_IO,   ATA_PRIMARY_CTRL,   0, ATA_PRIMARY_IRQ,   -1, 0 },
+    { ATA_SECONDARY_IO, ATA_SECONDARY_CTRL, 0, ATA_SECONDARY_IRQ, -1, 0 },
+};
+
+static AtaDrive drives[ATA_MAX_DRIVES];
+static int drive_count = 0;
+
 static inline uint16_t inw(uint16_t port) {
     uint16_t result;
     __asm__ volatile ("inw %1, %0" : "=a"(result) : "dN"(port));
@@ -34,69 +107,613 @@ static inline uint16_t inw(uint16_t port) {
 }
 
 
-static inline void ata_400ns_delay(void) {
-    (void)inb(ATA_REG_STATUS);
-    (void)inb(ATA_REG_STATUS);
-    (void)inb(ATA_REG_STATUS);
-    (void)inb(ATA_REG_STATUS);
+static inline void outw(uint16_t port, uint16_t value) {
+    __asm__ volatile ("outw %0, %1" : : "a"(value), "Nd"(port));
 }
 
-static int ata_wait_busy_clear(uint32_t spins) {
-    while (spins--) {
-        uint8_t s = inb(ATA_REG_STATUS);
+static inline void outl(uint16_t port, uint32_t value) {
+    __asm__ volatile ("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+// Alternate status on the control block doesn't ack a pending interrupt
+static inline void ata_400ns_delay(const AtaChannel* ch) {
+    (void)inb(ch->ctrl);
+    (void)inb(ch->ctrl);
+    (void)inb(ch->ctrl);
+    (void)inb(ch->ctrl);
+}
+
+// One extra tick: the current one may be about to end
+static inline uint64_t ata_deadline(uint32_t ms) {
+    return timer_ticks() + ms_to_ticks(ms) + 1;
+}
+
+// Polling waits, bounded by an absolute tick deadline rather than a spin count
+static int ata_wait_busy_clear(const AtaChannel* ch, uint64_t deadline) {
+    do {
+        uint8_t s = inb(ch->io + ATA_REG_STATUS);
         if (!(s & ATA_STATUS_BSY)) return 1;
-    }
-    return 0;
+        __asm__ volatile ("pause");
+    } while (timer_ticks() < deadline);
+    return !(inb(ch->io + ATA_REG_STATUS) & ATA_STATUS_BSY);
 }
 
-static int ata_wait_drq(uint32_t spins) {
-    while (spins--) {
-        uint8_t s = inb(ATA_REG_STATUS);
+static int ata_wait_drq(const AtaChannel* ch, uint64_t deadline) {
+    do {
+        uint8_t s = inb(ch->io + ATA_REG_STATUS);
         if (s & (ATA_STATUS_ERR | ATA_STATUS_DF)) return -1;
         if ((s & (ATA_STATUS_BSY | ATA_STATUS_DRQ)) == ATA_STATUS_DRQ) return 1;
-    }
+        __asm__ volatile ("pause");
+    } while (timer_ticks() < deadline);
     return 0;
 }
 
-void ata_read_sector(uint32_t lba, uint8_t* buffer) {
-    // Optional: disable IRQs from drive (nIEN=1 at ctrl), but DO NOT assert SRST
-    outb(ATA_PRIMARY_CTRL, 0x02); // nIEN=1, SRST=0
+/////// COMPLETION INTERRUPTS ////////////////////////////////////
+// Commands run with nIEN=0 and the issuing code sleeps in hlt until IRQ14
+// (or IRQ15 for the secondary channel) flags the channel. If an interrupt
+// never shows up but the drive turns out to be done, routing is broken:
+// log it once and fall back to deadline-bounded polling.
 
-    // Select drive (master) + LBA high nybble
-    outb(ATA_REG_HDDEVSEL, 0xE0 | ((lba >> 24) & 0x0F));
-    ata_400ns_delay();
+static uint8_t ata_use_irq = 0;
 
-    // Program sector count and 28-bit LBA
-    outb(ATA_REG_SECCOUNT0, 1);
-    outb(ATA_REG_LBA0, (uint8_t)(lba & 0xFF));
-    outb(ATA_REG_LBA1, (uint8_t)((lba >> 8) & 0xFF));
-    outb(ATA_REG_LBA2, (uint8_t)((lba >> 16) & 0xFF));
+void ata_irq(int channel) {
+    AtaChannel* ch = &channels[channel];
+    // Reading STATUS acks the drive's INTRQ
+    (void)inb(ch->io + ATA_REG_STATUS);
+    if (ch->bm) {
+        outb(ch->bm + BM_REG_STATUS, inb(ch->bm + BM_REG_STATUS) | BM_STATUS_IRQ); // write-1-to-clear
+    }
+    ch->irq_pending = 1;
+    irq_eoi(ch->irq);
+}
+
+// Sleep until the channel's IRQ arrives or the deadline passes. "sti; hlt"
+// only opens the interrupt window once hlt is executing, so a completion
+// between the check and the hlt still wakes us.
+static int ata_wait_irq(AtaChannel* ch, uint64_t deadline) {
+    for (;;) {
+        __asm__ volatile ("cli");
+        if (ch->irq_pending) {
+            ch->irq_pending = 0;
+            __asm__ volatile ("sti");
+            return 1;
+        }
+        if (timer_ticks() >= deadline) {
+            __asm__ volatile ("sti");
+            return 0;
+        }
+        __asm__ volatile ("sti; hlt");
+    }
+}
 
-    // Issue READ SECTORS
-    outb(ATA_REG_COMMAND, ATA_CMD_READ_PIO);
+// Block until the command's interrupt or deadline; a missed IRQ is only
+// fatal if the drive also isn't done, which the caller's status check decides.
+static void ata_sleep(AtaChannel* ch, uint64_t deadline) {
+    if (!ata_use_irq) return;
+    if (!ata_wait_irq(ch, deadline)) {
+        LOG(LOG_LEVEL_WARN, "ATA: no completion IRQ, switching to polling");
+        ata_use_irq = 0;
+    }
+}
 
-    // Wait for BSY=0 then DRQ=1
-    if (!ata_wait_busy_clear(1000000)) {
-        sfprint("ATA: timeout waiting BSY clear\n");
-        return;
+// Data port transfers go straight between the port and the caller's buffer,
+// one string instruction per block; x86 is little endian, so the words land
+// in the right byte order without repacking.
+static void ata_pio_in(const AtaChannel* ch, uint8_t* buffer, size_t words) {
+    __asm__ volatile ("rep insw"
+                      : "+D"(buffer), "+c"(words)
+                      : "d"((uint16_t)(ch->io + ATA_REG_DATA))
+                      : "memory");
+}
+
+static void ata_pio_out(const AtaChannel* ch, const uint8_t* buffer, size_t words) {
+    __asm__ volatile ("rep outsw"
+                      : "+S"(buffer), "+c"(words)
+                      : "d"((uint16_t)(ch->io + ATA_REG_DATA))
+                      : "memory");
+}
+
+// Poll for BSY=0, DRQ=1. 0 on success.
+static int ata_wait_ready(AtaChannel* ch, uint64_t deadline) {
+    if (!ata_wait_busy_clear(ch, deadline)) {
+        LOG(LOG_LEVEL_ERR, "ATA: timeout waiting BSY clear");
+        return -1;
     }
-    int drq = ata_wait_drq(1000000);
+    int drq = ata_wait_drq(ch, deadline);
     if (drq <= 0) {
         if (drq < 0) {
-            uint8_t err = inb(ATA_REG_ERROR);
-            sfprint("ATA: ERR/DF during read, ERR=%h\n", err);
+            uint8_t err = inb(ch->io + ATA_REG_ERROR);
+            LOG(LOG_LEVEL_ERR, "ATA: ERR/DF during transfer, ERR=%h", err);
         } else {
-            sfprint("ATA: timeout waiting DRQ\n");
+            LOG(LOG_LEVEL_ERR, "ATA: timeout waiting DRQ");
         }
+        return -1;
+    }
+    return 0;
+}
+
+// Sleep for the block's interrupt, then check DRQ. 0 on success.
+static int ata_wait_data(AtaChannel* ch, uint64_t deadline) {
+    ata_sleep(ch, deadline);
+    return ata_wait_ready(ch, deadline);
+}
+
+// After the final interrupt of a command: BSY must drop with no error.
+static int ata_wait_done(AtaChannel* ch, uint64_t deadline, const char* what) {
+    ata_sleep(ch, deadline);
+    if (!ata_wait_busy_clear(ch, deadline)) {
+        LOG(LOG_LEVEL_ERR, "ATA: timeout finishing %s", what);
+        return -1;
+    }
+    uint8_t st = inb(ch->io + ATA_REG_STATUS);
+    if (st & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        LOG(LOG_LEVEL_ERR, "ATA: %s failed, status=%h err=%h", what, st, inb(ch->io + ATA_REG_ERROR));
+        return -1;
+    }
+    return 0;
+}
+
+static void ata_select(AtaChannel* ch, uint8_t slave, uint8_t bits) {
+    outb(ch->io + ATA_REG_HDDEVSEL, 0xA0 | (slave << 4) | bits);
+    // Only a change of drive needs the settle delay
+    if (ch->selected != slave) {
+        ata_400ns_delay(ch);
+        ch->selected = slave;
+    }
+}
+
+/////// BUS MASTER DMA ////////////////////////////////////////
+// PIIX-style bus-master IDE. The controller walks a table of PRDs (physical
+// address, byte count, EOT flag) and moves the data itself; the CPU only
+// programs the command and waits for the engine to go idle.
+// Transfers go straight to or from the caller's buffer whenever the engine
+// can reach it; memory is identity mapped, so a virtually contiguous buffer
+// is physically contiguous too. The 64 KiB aligned bounce buffer is only
+// for buffers above 4 GiB or at odd addresses.
+// Commands are issued one at a time, so both channels share the table.
+
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;     // 0 means 64 KiB
+    uint16_t flags;     // PRD_EOT on the last entry
+} __attribute__((packed)) AtaPrd;
+
+static AtaPrd *prdt = NULL;
+static uint8_t *dma_buf = NULL;
+
+static void ata_dma_init(void) {
+    PciDevice ide;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide)) {
+        LOG(LOG_LEVEL_INFO, "ATA: no PCI IDE controller, PIO only");
         return;
     }
+    uint32_t bar4 = pci_read32(ide.bus, ide.dev, ide.fn, PCI_BAR4);
+    if (!(bar4 & 1)) {
+        LOG(LOG_LEVEL_INFO, "ATA: IDE controller has no bus-master I/O BAR");
+        return;
+    }
+    uint16_t cmd = pci_read16(ide.bus, ide.dev, ide.fn, PCI_COMMAND);
+    pci_write16(ide.bus, ide.dev, ide.fn, PCI_COMMAND, cmd | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+
+    uint64_t prd = alloc_frame();
+    uint64_t buf = alloc_frames_aligned(ATA_DMA_FRAMES, PRD_MAX_BYTES / PAGE_SIZE);
+    // PRDs hold 32-bit addresses
+    if (!prd || !buf || prd >= 0x100000000ULL || buf + ATA_DMA_BYTES > 0x100000000ULL) {
+        if (prd) free_frame(prd);
+        if (buf) free_frames(buf, ATA_DMA_FRAMES);
+        LOG(LOG_LEVEL_WARN, "ATA: no memory below 4 GiB for DMA, PIO only");
+        return;
+    }
+    channels[0].bm = (uint16_t)(bar4 & 0xFFFC);
+    channels[1].bm = (uint16_t)(bar4 & 0xFFFC) + 8;
+    prdt = (AtaPrd*)(uintptr_t)prd;
+    dma_buf = (uint8_t*)(uintptr_t)buf;
+    LOG(LOG_LEVEL_INFO, "ATA: bus-master DMA at io %x, pci %d:%d.%d",
+        (uint32_t)channels[0].bm, ide.bus, ide.dev, ide.fn);
+}
+
+// PRD addresses must be even and fit in 32 bits
+static int ata_dma_reachable(const uint8_t* buf, size_t bytes) {
+    uintptr_t addr = (uintptr_t)buf;
+    return !(addr & 1) && addr + bytes <= 0x100000000ULL;
+}
+
+// Fill the PRD table for exactly 'bytes' at 'buf', splitting wherever the
+// buffer crosses a 64 KiB boundary, which no PRD may do. The engine only
+// drops ACTIVE on its own once the table is used up, so it must match the
+// transfer size. A 128 KiB transfer needs at most three entries.
+static void ata_dma_prepare(const uint8_t* buf, size_t bytes) {
+    uintptr_t addr = (uintptr_t)buf;
+    uint32_t i = 0;
+    while (bytes > 0) {
+        size_t len = PRD_MAX_BYTES - (addr & (PRD_MAX_BYTES - 1));
+        if (len > bytes) len = bytes;
+        prdt[i].addr = (uint32_t)addr;
+        prdt[i].bytes = (uint16_t)len;  // 64 KiB wraps to 0, which is what the spec wants
+        prdt[i].flags = 0;
+        addr += len;
+        bytes -= len;
+        i++;
+    }
+    prdt[i - 1].flags = PRD_EOT;
+}
+
+/////// DRIVE DISCOVERY ////////////////////////////////////////
+
+// Run a no-data command (SET FEATURES, SET MULTIPLE) while probing. 0 on success.
+static int ata_probe_cmd(AtaChannel* ch, uint8_t slave, uint8_t command, uint8_t features, uint8_t count) {
+    ata_select(ch, slave, 0x40);
+    outb(ch->io + ATA_REG_FEATURES, features);
+    outb(ch->io + ATA_REG_SECCOUNT0, count);
+    outb(ch->io + ATA_REG_COMMAND, command);
+    ata_400ns_delay(ch);
+    if (!ata_wait_busy_clear(ch, ata_deadline(ATA_PROBE_TIMEOUT_MS))) return -1;
+    return (inb(ch->io + ATA_REG_STATUS) & (ATA_STATUS_ERR | ATA_STATUS_DF)) ? -1 : 0;
+}
+
+static int highest_bit(uint16_t v) {
+    return v ? 15 - __builtin_clz((uint32_t)v << 16) : -1;
+}
+
+// IDENTIFY one position. Returns 1 and fills *d for an ATA disk; 0 for an
+// empty slot, an ATAPI device, or a drive that doesn't answer.
+static int ata_identify(int channel, uint8_t slave, AtaDrive* d) {
+    AtaChannel* ch = &channels[channel];
+    uint16_t id[256];
+
+    outb(ch->ctrl, ATA_CTRL_NIEN);
+    ch->selected = -1;
+    ata_select(ch, slave, 0);
+    outb(ch->io + ATA_REG_SECCOUNT0, 0);
+    outb(ch->io + ATA_REG_LBA0, 0);
+    outb(ch->io + ATA_REG_LBA1, 0);
+    outb(ch->io + ATA_REG_LBA2, 0);
+    outb(ch->io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+
+    // 0 = nothing attached, 0xFF = floating bus (no channel)
+    uint8_t st = inb(ch->io + ATA_REG_STATUS);
+    if (st == 0 || st == 0xFF) return 0;
+
+    uint64_t deadline = ata_deadline(ATA_PROBE_TIMEOUT_MS);
+    if (!ata_wait_busy_clear(ch, deadline)) {
+        LOG(LOG_LEVEL_WARN, "ATA: IDENTIFY timeout on %d:%d", channel, slave);
+        return 0;
+    }
+    // ATAPI/SATA signatures abort IDENTIFY and leave LBA1/LBA2 nonzero
+    if (inb(ch->io + ATA_REG_LBA1) || inb(ch->io + ATA_REG_LBA2)) {
+        LOG(LOG_LEVEL_INFO, "ATA: %d:%d is not an ATA disk, skipping", channel, slave);
+        return 0;
+    }
+    if (ata_wait_drq(ch, deadline) <= 0) return 0;
+    ata_pio_in(ch, (uint8_t*)id, 256);
+
+    memset(d, 0, sizeof(*d));
+    d->present = 1;
+    d->channel = (uint8_t)channel;
+    d->slave = slave;
+    d->lba48 = (id[83] >> 10) & 1;
+    if (d->lba48) {
+        d->sectors = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                     ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+    } else {
+        d->sectors = (uint32_t)id[60] | ((uint32_t)id[61] << 16);
+    }
+    // Model string: words 27-46, bytes swapped within each word
+    for (int i = 0; i < 20; i++) {
+        d->model[i*2] = (char)(id[27 + i] >> 8);
+        d->model[i*2+1] = (char)(id[27 + i] & 0xFF);
+    }
+    int end = 40;
+    while (end > 0 && d->model[end - 1] == ' ') end--;
+    d->model[end] = '\0';
+
+    // Largest power-of-two DRQ block the drive reports (word 47, bits 0-7)
+    uint16_t max_multi = id[47] & 0xFF;
+    uint16_t multi = 1;
+    while ((uint16_t)(multi << 1) <= max_multi && multi < 128) multi <<= 1;
+    d->multi = 1;
+    if (multi > 1 && ata_probe_cmd(ch, slave, ATA_CMD_SET_MULTIPLE, 0, (uint8_t)multi) == 0) {
+        d->multi = multi;
+    }
+
+    // Fastest transfer mode: UDMA (word 88, valid if word 53 bit 2), then
+    // multiword DMA (word 63), then the best advertised PIO mode (word 64).
+    // Without an 80-conductor cable (word 93 bit 13) UDMA stops at mode 2.
+    int udma = (id[53] & (1 << 2)) ? highest_bit(id[88] & 0x7F) : -1;
+    if (udma > 2 && !(id[93] & (1 << 13))) udma = 2;
+    int mwdma = highest_bit(id[63] & 0x07);
+    int pio = (id[53] & (1 << 1)) ? highest_bit(id[64] & 0x03) + 3 : 2;
+    if (pio < 3) pio = 2;
+    if ((id[49] & (1 << 8)) && ch->bm && udma >= 0) {
+        d->xfer_mode = ATA_XFER_UDMA | udma;
+    } else if ((id[49] & (1 << 8)) && ch->bm && mwdma >= 0) {
+        d->xfer_mode = ATA_XFER_MWDMA | mwdma;
+    } else {
+        d->xfer_mode = ATA_XFER_PIO_FC | pio;
+    }
+    if (ata_probe_cmd(ch, slave, ATA_CMD_SET_FEATURES, ATA_FEAT_XFER_MODE, d->xfer_mode) == 0) {
+        d->dma = (d->xfer_mode & (ATA_XFER_UDMA | ATA_XFER_MWDMA)) != 0;
+    } else {
+        // Drive refused the mode; stay on its power-on PIO default
+        d->xfer_mode = ATA_XFER_PIO_FC | 2;
+        d->dma = 0;
+    }
+    return 1;
+}
+
+static const char* ata_mode_name(uint8_t mode) {
+    if (mode & ATA_XFER_UDMA) return "UDMA";
+    if (mode & ATA_XFER_MWDMA) return "MWDMA";
+    return "PIO";
+}
+
+/////// BLOCK DEVICE ////////////////////////////////////////
+// Each disk is registered as "hdN", N being its ata_read drive number.
+
+static BlkDev ata_devs[ATA_MAX_DRIVES];
+
+static int ata_dev_read(BlkDev* dev, uint64_t lba, uint32_t count, uint8_t* buf) {
+    return ata_read((int)(uintptr_t)dev->priv, lba, count, buf);
+}
+
+static int ata_dev_write(BlkDev* dev, uint64_t lba, uint32_t count, const uint8_t* buf) {
+    return ata_write((int)(uintptr_t)dev->priv, lba, count, buf);
+}
+
+static int ata_dev_flush(BlkDev* dev) {
+    return ata_flush((int)(uintptr_t)dev->priv);
+}
+
+static const BlkDevOps ata_ops = { ata_dev_read, ata_dev_write, ata_dev_flush };
+
+static void ata_register(int idx) {
+    BlkDev* dev = &ata_devs[idx];
+    const AtaDrive* d = &drives[idx];
+    blkdev_name(dev, "hd", idx);
+    dev->ops = &ata_ops;
+    dev->sector_size = ATA_SECTOR_SIZE;
+    dev->sectors = d->lba48 ? d->sectors : ((d->sectors < ATA_LBA28_LIMIT) ? d->sectors : ATA_LBA28_LIMIT);
+    dev->priv = (void*)(uintptr_t)idx;
+    blkdev_register(dev);
+}
+
+// Probe master and slave on both legacy channels. Bus-master DMA is set up
+// first so each drive's mode can be chosen knowing whether DMA is usable.
+void ata_init(void) {
+    ata_dma_init();
+
+    for (int c = 0; c < 2; c++) {
+        for (uint8_t slave = 0; slave < 2; slave++) {
+            AtaDrive* d = &drives[drive_count];
+            if (!ata_identify(c, slave, d)) continue;
+            LOG(LOG_LEVEL_INFO, "ATA: disk %d at %d:%d \"%s\" %8 sectors%s, multi %d, %s%d",
+                drive_count, c, slave, d->model, d->sectors, d->lba48 ? " LBA48" : "",
+                d->multi, ata_mode_name(d->xfer_mode), d->xfer_mode & 0x07);
+            drive_count++;
+        }
+    }
+    if (!drive_count) {
+        LOG(LOG_LEVEL_WARN, "ATA: no disks found");
+    }
+
+    // Probing ran with nIEN=1; data commands from here on interrupt.
+    irq_unmask(ATA_PRIMARY_IRQ);
+    irq_unmask(ATA_SECONDARY_IRQ);
+    ata_use_irq = 1;
+
+    for (int i = 0; i < drive_count; i++) {
+        ata_register(i);
+    }
+}
+
+int ata_drive_count(void) {
+    return drive_count;
+}
+
+const AtaDrive* ata_drive(int idx) {
+    return (idx >= 0 && idx < drive_count) ? &drives[idx] : NULL;
+}
+
+/////// TRANSFERS ////////////////////////////////////////
+
+// Program the taskfile for 1..ATA_MAX_SECTORS sectors (a SECCOUNT of 0 means
+// 256 to the drive) and send the command. 48-bit commands write the high
+// bytes of count and LBA first into the same registers.
+static void ata_issue(const AtaDrive* d, uint64_t lba, uint32_t count, uint8_t command, int ext) {
+    AtaChannel* ch = &channels[d->channel];
+    outb(ch->ctrl, ata_use_irq ? 0 : ATA_CTRL_NIEN); // SRST=0
+    ch->irq_pending = 0;
+
+    if (ext) {
+        ata_select(ch, d->slave, 0x40);
+        outb(ch->io + ATA_REG_SECCOUNT0, (uint8_t)(count >> 8));
+        outb(ch->io + ATA_REG_LBA0, (uint8_t)(lba >> 24));
+        outb(ch->io + ATA_REG_LBA1, (uint8_t)(lba >> 32));
+        outb(ch->io + ATA_REG_LBA2, (uint8_t)(lba >> 40));
+    } else {
+        // LBA mode + high nybble of the 28-bit LBA
+        ata_select(ch, d->slave, 0x40 | ((lba >> 24) & 0x0F));
+    }
+    outb(ch->io + ATA_REG_SECCOUNT0, (uint8_t)count);
+    outb(ch->io + ATA_REG_LBA0, (uint8_t)(lba & 0xFF));
+    outb(ch->io + ATA_REG_LBA1, (uint8_t)((lba >> 8) & 0xFF));
+    outb(ch->io + ATA_REG_LBA2, (uint8_t)((lba >> 16) & 0xFF));
+
+    outb(ch->io + ATA_REG_COMMAND, command);
+}
+
+// One READ/WRITE DMA to or from 'buf', which the engine must be able to reach.
+static int ata_dma_cmd(const AtaDrive* d, uint64_t lba, uint32_t count, uint8_t* buf, int write, int ext) {
+    AtaChannel* ch = &channels[d->channel];
+    uint8_t dir = write ? 0 : BM_CMD_READ;
+    uint8_t command = write ? (ext ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA)
+                            : (ext ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+
+    ata_dma_prepare(buf, (size_t)count * ATA_SECTOR_SIZE);
+    outb(ch->bm + BM_REG_CMD, 0);
+    outl(ch->bm + BM_REG_PRDT, (uint32_t)(uintptr_t)prdt);
+    // ERR and IRQ are write-1-to-clear
+    outb(ch->bm + BM_REG_STATUS, inb(ch->bm + BM_REG_STATUS) | BM_STATUS_ERR | BM_STATUS_IRQ);
+    outb(ch->bm + BM_REG_CMD, dir);
+
+    ata_issue(d, lba, count, command, ext);
+    outb(ch->bm + BM_REG_CMD, dir | BM_CMD_START);
+
+    uint64_t deadline = ata_deadline(ATA_TIMEOUT_MS);
+    ata_sleep(ch, deadline);
+    uint8_t bm;
+    do {
+        bm = inb(ch->bm + BM_REG_STATUS);
+    } while ((bm & BM_STATUS_ACTIVE) && !(bm & BM_STATUS_ERR) && timer_ticks() < deadline);
+    outb(ch->bm + BM_REG_CMD, 0);
+
+    if ((bm & BM_STATUS_ACTIVE) && !(bm & BM_STATUS_ERR)) {
+        LOG(LOG_LEVEL_ERR, "ATA: DMA timeout, lba %8", lba);
+        return -1;
+    }
+    if (!ata_wait_busy_clear(ch, deadline)) {
+        LOG(LOG_LEVEL_ERR, "ATA: timeout waiting BSY clear after DMA");
+        return -1;
+    }
+    uint8_t st = inb(ch->io + ATA_REG_STATUS);
+    if ((bm & BM_STATUS_ERR) || (st & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        LOG(LOG_LEVEL_ERR, "ATA: DMA error, bm=%h status=%h err=%h", bm, st, inb(ch->io + ATA_REG_ERROR));
+        return -1;
+    }
+    return 0;
+}
+
+static int ata_read_cmd(AtaDrive* d, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    AtaChannel* ch = &channels[d->channel];
+    // 28-bit commands are a few port writes cheaper; only go 48-bit past them
+    int ext = (lba + count > ATA_LBA28_LIMIT);
 
-    // Read 256 words (512 bytes)
-    for (int i = 0; i < 256; i++) {
-        uint16_t w = inw(ATA_REG_DATA);
-        buffer[i*2+0] = (uint8_t)(w & 0xFF);
-        buffer[i*2+1] = (uint8_t)(w >> 8);
+    if (d->dma) {
+        size_t bytes = (size_t)count * ATA_SECTOR_SIZE;
+        int direct = ata_dma_reachable(buffer, bytes);
+        if (ata_dma_cmd(d, lba, count, direct ? buffer : dma_buf, 0, ext) == 0) {
+            if (!direct) memcpy(buffer, dma_buf, bytes);
+            return 0;
+        }
+        // Drop to PIO for good rather than fail every request the same way
+        LOG(LOG_LEVEL_WARN, "ATA: disabling DMA on %d:%d, falling back to PIO", d->channel, d->slave);
+        d->dma = 0;
+    }
+
+    uint8_t command = (d->multi > 1) ? (ext ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE)
+                                     : (ext ? ATA_CMD_READ_PIO_EXT : ATA_CMD_READ_PIO);
+    ata_issue(d, lba, count, command, ext);
+
+    // The drive raises DRQ (and an IRQ) once per block of d->multi sectors;
+    // the last block is short when count isn't a multiple of it.
+    while (count > 0) {
+        uint32_t blk = (count < d->multi) ? count : d->multi;
+        if (ata_wait_data(ch, ata_deadline(ATA_TIMEOUT_MS)) < 0) return -1;
+        ata_pio_in(ch, buffer, blk * 256);
+        buffer += blk * 512;
+        count -= blk;
+        ata_400ns_delay(ch);
+    }
+    return 0;
+}
+
+static AtaDrive* ata_check_range(int drive, uint64_t lba, uint32_t count);
+
+int ata_read(int drive, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    AtaDrive* d = ata_check_range(drive, lba, count);
+    if (!d) return -1;
+    while (count > 0) {
+        uint32_t n = (count < ATA_MAX_SECTORS) ? count : ATA_MAX_SECTORS;
+        if (ata_read_cmd(d, lba, n, buffer) < 0) return -1;
+        lba += n;
+        buffer += n * 512;
+        count -= n;
+    }
+    return 0;
+}
+
+static int ata_write_cmd(AtaDrive* d, uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    AtaChannel* ch = &channels[d->channel];
+    int ext = (lba + count > ATA_LBA28_LIMIT);
+
+    if (d->dma) {
+        size_t bytes = (size_t)count * ATA_SECTOR_SIZE;
+        int direct = ata_dma_reachable(buffer, bytes);
+        if (!direct) memcpy(dma_buf, buffer, bytes);
+        if (ata_dma_cmd(d, lba, count, direct ? (uint8_t*)buffer : dma_buf, 1, ext) == 0) {
+            return 0;
+        }
+        LOG(LOG_LEVEL_WARN, "ATA: disabling DMA on %d:%d, falling back to PIO", d->channel, d->slave);
+        d->dma = 0;
     }
+
+    uint8_t command = (d->multi > 1) ? (ext ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE)
+                                     : (ext ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_WRITE_PIO);
+    ata_issue(d, lba, count, command, ext);
+
+    // Writes run the other way round from reads: DRQ for the first block
+    // comes without an interrupt, and an interrupt follows every block sent,
+    // the last one included.
+    uint64_t deadline = ata_deadline(ATA_TIMEOUT_MS);
+    if (ata_wait_ready(ch, deadline) < 0) return -1;
+    while (count > 0) {
+        uint32_t blk = (count < d->multi) ? count : d->multi;
+        ata_pio_out(ch, buffer, blk * 256);
+        buffer += blk * 512;
+        count -= blk;
+        if (count > 0 && ata_wait_data(ch, ata_deadline(ATA_TIMEOUT_MS)) < 0) return -1;
+    }
+    return ata_wait_done(ch, ata_deadline(ATA_TIMEOUT_MS), "write");
+}
+
+static AtaDrive* ata_check_range(int drive, uint64_t lba, uint32_t count) {
+    if (drive < 0 || drive >= drive_count) {
+        LOG(LOG_LEVEL_ERR, "ATA: no disk %d", drive);
+        return NULL;
+    }
+    AtaDrive* d = &drives[drive];
+    uint64_t limit = d->lba48 ? d->sectors : ((d->sectors < ATA_LBA28_LIMIT) ? d->sectors : ATA_LBA28_LIMIT);
+    if (lba + count > limit || lba + count < lba) {
+        LOG(LOG_LEVEL_ERR, "ATA: %8+%8 past end of disk %d (%8 sectors)", lba, (uint64_t)count, drive, limit);
+        return NULL;
+    }
+    return d;
+}
+
+int ata_write(int drive, uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    AtaDrive* d = ata_check_range(drive, lba, count);
+    if (!d) return -1;
+    while (count > 0) {
+        uint32_t n = (count < ATA_MAX_SECTORS) ? count : ATA_MAX_SECTORS;
+        if (ata_write_cmd(d, lba, n, buffer) < 0) return -1;
+        lba += n;
+        buffer += n * 512;
+        count -= n;
+    }
+    return 0;
+}
+
+int ata_flush(int drive) {
+    if (drive < 0 || drive >= drive_count) return -1;
+    AtaDrive* d = &drives[drive];
+    AtaChannel* ch = &channels[d->channel];
+    outb(ch->ctrl, ata_use_irq ? 0 : ATA_CTRL_NIEN);
+    ch->irq_pending = 0;
+    ata_select(ch, d->slave, 0x40);
+    outb(ch->io + ATA_REG_COMMAND, d->lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE);
+    return ata_wait_done(ch, ata_deadline(ATA_FLUSH_TIMEOUT_MS), "flush");
+}
+
+int ata_write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    return ata_write(0, lba, count, buffer);
+}
+
+int ata_read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer) {
+    return ata_read(0, lba, count, buffer);
+}
+
+void ata_read_sector(uint32_t lba, uint8_t* buffer) {
+    ata_read_sectors(lba, 1, buffer);
 }
 
 
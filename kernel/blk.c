@@ -0,0 +1,631 @@
+#include "blk.h"
+#include "mem.h"
+#include "string.h"
+#include "serial.h"
+#include "idt.h"
+#include "assertf.h"
+
+// The device every request goes to; NULL until blk_attach
+static BlkDev *dev = NULL;
+
+// Pending requests, sorted by LBA ascending
+static BlkRequest *queue = NULL;
+
+// Requests already satisfied from the cache, waiting for their callback
+static BlkRequest *done_list = NULL;
+static BlkRequest **done_tail = &done_list;
+
+// Where the previous dispatch left the head. The elevator sweeps upward from
+// here and wraps to the lowest LBA (C-SCAN), so no region starves.
+static uint64_t head_lba = 0;
+
+// Scratch for merged batches whose caller buffers aren't contiguous
+static uint8_t *merge_buf = NULL;
+
+#define BLK_MERGE_FRAMES (BLK_MAX_SECTORS * BLK_SECTOR_SIZE / PAGE_SIZE)
+
+static uint8_t *blk_scratch(void) {
+    if (!merge_buf) {
+        merge_buf = (uint8_t*)(uintptr_t)alloc_frames(BLK_MERGE_FRAMES);
+    }
+    return merge_buf;
+}
+
+/////// SECTOR CACHE ////////////////////////////////////////
+// Every sector that comes off the disk is kept in an LRU cache, hashed by
+// LBA, sized by BLK_CACHE_KB and carved from the frame allocator on first
+// use. A request whose sectors are all cached completes without touching
+// the disk. Writes update cached copies in place, so the cache always holds
+// the newest data.
+
+#define BLK_CACHE_SECTORS (BLK_CACHE_KB * 1024 / BLK_SECTOR_SIZE)
+#define BLK_CACHE_BUCKETS BLK_CACHE_SECTORS   // power of two, ~1 entry per chain
+#define BLK_NIL (-1)
+
+typedef struct {
+    uint64_t lba;
+    int32_t  hnext;      // hash chain
+    int32_t  prev;       // LRU list, head = most recent
+    int32_t  next;
+} CacheEnt;
+
+static CacheEnt *cache_ent = NULL;
+static int32_t *cache_bucket = NULL;
+static uint8_t *cache_data = NULL;
+static int32_t cache_used = 0;
+static int32_t lru_head = BLK_NIL;
+static int32_t lru_tail = BLK_NIL;
+static int cache_state = 0;          // 0 not set up, 1 ready, -1 no memory
+static BlkStats stats;
+
+static int cache_ready(void) {
+    if (cache_state) return cache_state > 0;
+    size_t data_frames = (size_t)BLK_CACHE_SECTORS * BLK_SECTOR_SIZE / PAGE_SIZE;
+    size_t meta_bytes = (size_t)BLK_CACHE_SECTORS * sizeof(CacheEnt) + BLK_CACHE_BUCKETS * sizeof(int32_t);
+    size_t meta_frames = (meta_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t data = alloc_frames(data_frames);
+    uint64_t meta = alloc_frames(meta_frames);
+    if (!data || !meta) {
+        if (data) free_frames(data, data_frames);
+        if (meta) free_frames(meta, meta_frames);
+        LOG(LOG_LEVEL_ERR, "blk: no memory for a %d KiB sector cache", BLK_CACHE_KB);
+        cache_state = -1;
+        return 0;
+    }
+    cache_data = (uint8_t*)(uintptr_t)data;
+    cache_ent = (CacheEnt*)(uintptr_t)meta;
+    cache_bucket = (int32_t*)(cache_ent + BLK_CACHE_SECTORS);
+    for (int i = 0; i < BLK_CACHE_BUCKETS; i++) cache_bucket[i] = BLK_NIL;
+    cache_state = 1;
+    return 1;
+}
+
+static inline uint32_t cache_hash(uint64_t lba) {
+    return ((uint32_t)(lba ^ (lba >> 32)) * 2654435761u) & (BLK_CACHE_BUCKETS - 1);
+}
+
+static inline uint8_t *cache_sector(int32_t i) {
+    return cache_data + (size_t)i * BLK_SECTOR_SIZE;
+}
+
+static int32_t cache_find(uint64_t lba) {
+    if (cache_state <= 0) return BLK_NIL;
+    for (int32_t i = cache_bucket[cache_hash(lba)]; i != BLK_NIL; i = cache_ent[i].hnext) {
+        if (cache_ent[i].lba == lba) return i;
+    }
+    return BLK_NIL;
+}
+
+static void lru_unlink(int32_t i) {
+    CacheEnt *e = &cache_ent[i];
+    if (e->prev != BLK_NIL) cache_ent[e->prev].next = e->next; else lru_head = e->next;
+    if (e->next != BLK_NIL) cache_ent[e->next].prev = e->prev; else lru_tail = e->prev;
+}
+
+static void lru_push_front(int32_t i) {
+    cache_ent[i].prev = BLK_NIL;
+    cache_ent[i].next = lru_head;
+    if (lru_head != BLK_NIL) cache_ent[lru_head].prev = i;
+    lru_head = i;
+    if (lru_tail == BLK_NIL) lru_tail = i;
+}
+
+static void cache_touch(int32_t i) {
+    if (lru_head == i) return;
+    lru_unlink(i);
+    lru_push_front(i);
+}
+
+static void hash_unlink(int32_t i) {
+    int32_t *link = &cache_bucket[cache_hash(cache_ent[i].lba)];
+    while (*link != i) link = &cache_ent[*link].hnext;
+    *link = cache_ent[i].hnext;
+}
+
+// Store a sector, reusing its entry if cached, else a fresh one, else the LRU tail
+static void cache_insert(uint64_t lba, const uint8_t *data) {
+    if (!cache_ready()) return;
+    int32_t i = cache_find(lba);
+    if (i == BLK_NIL) {
+        if (cache_used < BLK_CACHE_SECTORS) {
+            i = cache_used++;
+        } else {
+            i = lru_tail;
+            lru_unlink(i);
+            hash_unlink(i);
+        }
+        cache_ent[i].lba = lba;
+        uint32_t h = cache_hash(lba);
+        cache_ent[i].hnext = cache_bucket[h];
+        cache_bucket[h] = i;
+        lru_push_front(i);
+    } else {
+        cache_touch(i);
+    }
+    memcpy(cache_sector(i), data, BLK_SECTOR_SIZE);
+}
+
+// Serve a request entirely from cache, or not at all
+static int cache_fill(BlkRequest *req) {
+    if (cache_state <= 0) return 0;
+    for (uint32_t k = 0; k < req->count; k++) {
+        if (cache_find(req->lba + k) == BLK_NIL) return 0;
+    }
+    for (uint32_t k = 0; k < req->count; k++) {
+        int32_t i = cache_find(req->lba + k);
+        cache_touch(i);
+        memcpy(req->buf + (size_t)k * BLK_SECTOR_SIZE, cache_sector(i), BLK_SECTOR_SIZE);
+    }
+    stats.hits += req->count;
+    return 1;
+}
+
+// Copy the cached sectors a request starts with and step it past them, so
+// only the rest goes to the disk. Returns how many it skipped; the caller
+// steps it back before completing it.
+static uint32_t cache_fill_front(BlkRequest *req) {
+    if (cache_state <= 0) return 0;
+    uint32_t k = 0;
+    int32_t i;
+    while (k + 1 < req->count && (i = cache_find(req->lba + k)) != BLK_NIL) {
+        cache_touch(i);
+        memcpy(req->buf + (size_t)k * BLK_SECTOR_SIZE, cache_sector(i), BLK_SECTOR_SIZE);
+        k++;
+    }
+    req->lba += k;
+    req->buf += (size_t)k * BLK_SECTOR_SIZE;
+    req->count -= k;
+    stats.hits += k;
+    return k;
+}
+
+// Forget every cached sector, e.g. when the device underneath changes
+static void cache_clear(void) {
+    if (cache_state <= 0) return;
+    for (int i = 0; i < BLK_CACHE_BUCKETS; i++) cache_bucket[i] = BLK_NIL;
+    cache_used = 0;
+    lru_head = BLK_NIL;
+    lru_tail = BLK_NIL;
+}
+
+// Keep cached copies of written sectors current
+static void cache_update(uint64_t lba, uint32_t count, const uint8_t *buf) {
+    for (uint32_t k = 0; k < count; k++) {
+        int32_t i = cache_find(lba + k);
+        if (i != BLK_NIL) memcpy(cache_sector(i), buf + (size_t)k * BLK_SECTOR_SIZE, BLK_SECTOR_SIZE);
+    }
+}
+
+void blk_stats(BlkStats *out) {
+    *out = stats;
+    out->cached = (uint32_t)cache_used;
+    out->capacity = BLK_CACHE_SECTORS;
+}
+
+/////// WRITE-BACK ////////////////////////////////////////
+// Written sectors wait in a frame-backed pool, indexed by a table kept
+// sorted by LBA, until blk_sync() or the writeback timer sends them out.
+// Runs of adjacent LBAs go to the drive as one command. Slots are handed
+// out in order and only freed all together at writeback, so the next free
+// slot is always dirty_count.
+
+static uint64_t dirty_lba[BLK_DIRTY_MAX];
+static uint16_t dirty_slot[BLK_DIRTY_MAX];
+static int dirty_count = 0;
+static uint8_t *dirty_pool = NULL;
+static uint64_t dirty_since = 0;     // tick of the oldest unsynced write
+
+#define BLK_DIRTY_FRAMES (BLK_DIRTY_MAX * BLK_SECTOR_SIZE / PAGE_SIZE)
+
+static inline uint8_t *dirty_data(int pos) {
+    return dirty_pool + (size_t)dirty_slot[pos] * BLK_SECTOR_SIZE;
+}
+
+// First index whose LBA is >= lba
+static int dirty_find(uint64_t lba) {
+    int lo = 0, hi = dirty_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (dirty_lba[mid] < lba) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Dirty data is newer than the disk; patch it over a completed read
+static void dirty_overlay(BlkRequest *req) {
+    for (int pos = dirty_find(req->lba); pos < dirty_count && dirty_lba[pos] < req->lba + req->count; pos++) {
+        memcpy(req->buf + (size_t)(dirty_lba[pos] - req->lba) * BLK_SECTOR_SIZE, dirty_data(pos), BLK_SECTOR_SIZE);
+    }
+}
+
+static int blk_writeback(void) {
+    uint8_t *stage = blk_scratch();
+    int pos = 0;
+    while (pos < dirty_count) {
+        int end = pos + 1;
+        while (end < dirty_count && end - pos < BLK_MAX_SECTORS &&
+               dirty_lba[end] == dirty_lba[end - 1] + 1) {
+            end++;
+        }
+        int status;
+        if (stage) {
+            for (int i = pos; i < end; i++) {
+                memcpy(stage + (size_t)(i - pos) * BLK_SECTOR_SIZE, dirty_data(i), BLK_SECTOR_SIZE);
+            }
+            status = blkdev_write(dev, dirty_lba[pos], end - pos, stage);
+        } else {
+            status = 0;
+            for (int i = pos; i < end && status == 0; i++) {
+                status = blkdev_write(dev, dirty_lba[i], 1, dirty_data(i));
+            }
+        }
+        if (status < 0) {
+            // Keep everything dirty; rewriting the runs that did land is
+            // harmless and keeps slots 0..dirty_count-1 all in use.
+            return -1;
+        }
+        LOG(LOG_LEVEL_DEBUG, "blk: wrote lba %8 +%d", (uint64_t)dirty_lba[pos], end - pos);
+        pos = end;
+    }
+    dirty_count = 0;
+    return 0;
+}
+
+static uint32_t write_gen = 0;
+
+uint32_t blk_write_generation(void) {
+    return write_gen;
+}
+
+int blk_write(uint64_t lba, uint32_t count, const uint8_t *buf) {
+    write_gen++;
+    cache_update(lba, count, buf);
+    if (!dirty_pool) {
+        dirty_pool = (uint8_t*)(uintptr_t)alloc_frames(BLK_DIRTY_FRAMES);
+        if (!dirty_pool) {
+            // No memory to buffer in: write straight through
+            return blkdev_write(dev, lba, count, buf);
+        }
+    }
+    for (uint32_t i = 0; i < count; i++, buf += BLK_SECTOR_SIZE) {
+        uint64_t s = lba + i;
+        int pos = dirty_find(s);
+        if (pos < dirty_count && dirty_lba[pos] == s) {
+            memcpy(dirty_data(pos), buf, BLK_SECTOR_SIZE);
+            continue;
+        }
+        if (dirty_count == BLK_DIRTY_MAX) {
+            if (blk_writeback() < 0) return -1;
+            pos = 0;
+        }
+        memmove(&dirty_lba[pos + 1], &dirty_lba[pos], (dirty_count - pos) * sizeof(dirty_lba[0]));
+        memmove(&dirty_slot[pos + 1], &dirty_slot[pos], (dirty_count - pos) * sizeof(dirty_slot[0]));
+        dirty_lba[pos] = s;
+        dirty_slot[pos] = (uint16_t)dirty_count;
+        if (dirty_count++ == 0) dirty_since = timer_ticks();
+        memcpy(dirty_data(pos), buf, BLK_SECTOR_SIZE);
+    }
+    return 0;
+}
+
+int blk_sync(void) {
+    if (dirty_count == 0) return 0;
+    if (blk_writeback() < 0) return -1;
+    return blkdev_flush(dev);
+}
+
+int blk_busy(void) {
+    return queue || done_list || dirty_count;
+}
+
+void blk_idle(void) {
+    blk_run();
+    if (dirty_count && timer_ticks() - dirty_since >= ms_to_ticks(BLK_WRITEBACK_MS)) {
+        if (blk_sync() < 0) {
+            // Try again a full interval later instead of on every wakeup
+            dirty_since = timer_ticks();
+        }
+    }
+}
+
+/////// READ-AHEAD ////////////////////////////////////////
+// blk_prefetch queues a read whose only job is to fill the sector cache.
+// Its data lands in a staging area carved from frames, which is handed out
+// linearly and reused once every prefetch in flight has completed.
+
+#define BLK_RA_SECTORS 256
+#define BLK_RA_FRAMES  (BLK_RA_SECTORS * BLK_SECTOR_SIZE / PAGE_SIZE)
+#define BLK_RA_REQS    16
+
+static BlkRequest ra_req[BLK_RA_REQS];
+static uint8_t *ra_buf = NULL;
+static uint32_t ra_used = 0;         // sectors of ra_buf handed out
+static int ra_nreq = 0;              // ra_req slots handed out
+static int ra_inflight = 0;
+
+static void ra_done(BlkRequest *req, int status) {
+    (void)req;
+    (void)status;
+    if (--ra_inflight == 0) {
+        ra_used = 0;
+        ra_nreq = 0;
+    }
+}
+
+uint32_t blk_prefetch(uint64_t lba, uint32_t count) {
+    if (!cache_ready()) return 0;
+    uint32_t want = count;
+    // Only the uncached middle is worth reading
+    uint32_t skip = 0;
+    while (count && cache_find(lba) != BLK_NIL) { lba++; count--; skip++; }
+    while (count && cache_find(lba + count - 1) != BLK_NIL) count--;
+    if (!count) return want;
+    if (!ra_buf) {
+        ra_buf = (uint8_t*)(uintptr_t)alloc_frames(BLK_RA_FRAMES);
+        if (!ra_buf) return skip;
+    }
+    if (ra_nreq == BLK_RA_REQS || ra_used == BLK_RA_SECTORS) return skip;
+    if (count > BLK_RA_SECTORS - ra_used) {
+        count = BLK_RA_SECTORS - ra_used;
+        want = skip + count;
+    }
+    BlkRequest *req = &ra_req[ra_nreq++];
+    req->lba = lba;
+    req->count = count;
+    req->buf = ra_buf + (size_t)ra_used * BLK_SECTOR_SIZE;
+    req->done = ra_done;
+    req->ctx = NULL;
+    ra_used += count;
+    ra_inflight++;
+    blk_submit(req);
+    return want;
+}
+
+void blk_submit(BlkRequest *req) {
+    req->status = BLK_PENDING;
+    // Cache hits skip the queue; blk_run delivers their callbacks in order
+    if (cache_fill(req)) {
+        req->next = NULL;
+        *done_tail = req;
+        done_tail = &req->next;
+        return;
+    }
+    BlkRequest **link = &queue;
+    // Equal LBAs keep submission order, except that a demand read goes
+    // ahead of prefetches: read-ahead starts where the next sequential read
+    // will, and queued behind it, it merges onto that read's end
+    int ra = (req->done == ra_done);
+    while (*link && ((*link)->lba < req->lba ||
+                     ((*link)->lba == req->lba && (ra || (*link)->done != ra_done)))) {
+        link = &(*link)->next;
+    }
+    req->next = *link;
+    *link = req;
+}
+
+static BlkRequest **blk_pick(void) {
+    BlkRequest **link = &queue;
+    while (*link && (*link)->lba < head_lba) {
+        link = &(*link)->next;
+    }
+    return *link ? link : &queue;
+}
+
+// Read a batch of adjacent or overlapping requests. One command when their
+// buffers line up or the merge buffer is available; otherwise one command each.
+static int blk_dispatch(BlkRequest *first, uint32_t total, int contiguous) {
+    if (contiguous) {
+        return blkdev_read(dev, first->lba, total, first->buf);
+    }
+    if (blk_scratch()) {
+        if (blkdev_read(dev, first->lba, total, merge_buf) < 0) return -1;
+        for (BlkRequest *r = first; r; r = r->next) {
+            size_t off = (size_t)(r->lba - first->lba) * BLK_SECTOR_SIZE;
+            memcpy(r->buf, merge_buf + off, (size_t)r->count * BLK_SECTOR_SIZE);
+        }
+        return 0;
+    }
+    for (BlkRequest *r = first; r; r = r->next) {
+        if (blkdev_read(dev, r->lba, r->count, r->buf) < 0) return -1;
+    }
+    return 0;
+}
+
+static void blk_complete(BlkRequest *r, int status) {
+    r->next = NULL;
+    r->status = status;
+    if (r->done) r->done(r, status);
+}
+
+// Shrink a queued prefetch to what's still worth reading once it is about
+// to go out: it starts at 'from', where the batch ahead of it ends (0 when
+// there is none), and demand reads may have cached its ends since it was
+// queued. Returns the sectors left.
+static uint32_t ra_trim(BlkRequest *r, uint64_t from) {
+    if (r->lba < from) {
+        uint64_t skip = from - r->lba;
+        if (skip >= r->count) {
+            r->count = 0;
+            return 0;
+        }
+        r->lba = from;
+        r->buf += (size_t)skip * BLK_SECTOR_SIZE;
+        r->count -= (uint32_t)skip;
+    }
+    while (r->count && cache_find(r->lba) != BLK_NIL) {
+        r->lba++;
+        r->buf += BLK_SECTOR_SIZE;
+        r->count--;
+    }
+    while (r->count && cache_find(r->lba + r->count - 1) != BLK_NIL) r->count--;
+    return r->count;
+}
+
+int blk_step(void) {
+    if (!queue && !done_list) return 0;
+    // Cache hits first: they cost nothing and unblock their callers, who
+    // get to queue more before anything else goes out. A prefetch left
+    // behind then merges onto their next read instead of going alone.
+    if (done_list) {
+        while (done_list) {
+            BlkRequest *r = done_list;
+            done_list = r->next;
+            if (!done_list) done_tail = &done_list;
+            blk_complete(r, 0);
+        }
+        return 1;
+    }
+
+    BlkRequest **link = blk_pick();
+    BlkRequest *first = *link;
+    // A read queued behind a prefetch of the same sectors may be
+    // cached by now, and a prefetch may have nothing left to fetch
+    if ((first->done == ra_done) ? ra_trim(first, 0) == 0 : cache_fill(first)) {
+        *link = first->next;
+        blk_complete(first, 0);
+        return 1;
+    }
+    // Read-ahead that went out with an earlier batch may have cached the
+    // front of a demand read; only the rest needs reading
+    uint32_t front = (first->done == ra_done) ? 0 : cache_fill_front(first);
+    BlkRequest *last = first;
+    uint64_t end = first->lba + first->count;
+    int contiguous = 1;
+    int merged = 0;
+
+    // Grow the batch while the next request starts inside it or where it
+    // ends. A demand read that falls inside a prefetch ahead of it (the tail
+    // of a sequential read, say) shares its command rather than cutting it.
+    for (;;) {
+        BlkRequest *next = last->next;
+        if (next && next->done == ra_done && ra_trim(next, end) == 0) {
+            last->next = next->next;
+            blk_complete(next, 0);
+            continue;
+        }
+        if (!next || next->lba > end) break;
+        uint64_t next_end = next->lba + next->count;
+        if (next_end < end) next_end = end;
+        if (next_end - first->lba > BLK_MAX_SECTORS) break;
+        if (next->lba != end ||
+            next->buf != last->buf + (size_t)last->count * BLK_SECTOR_SIZE) {
+            contiguous = 0;
+        }
+        end = next_end;
+        last = next;
+        merged++;
+    }
+    uint32_t total = (uint32_t)(end - first->lba);
+    *link = last->next;
+    last->next = NULL;
+
+    LOG(LOG_LEVEL_DEBUG, "blk: lba %8 +%d (%d merged)", (uint64_t)first->lba, total, merged);
+    int status = blk_dispatch(first, total, contiguous);
+    head_lba = first->lba + total;
+    stats.commands++;
+
+    // Callbacks may free or resubmit their request, so step first
+    BlkRequest *r = first;
+    while (r) {
+        BlkRequest *next = r->next;
+        if (r->done == ra_done) stats.readahead += r->count;
+        else stats.misses += r->count;
+        if (status == 0) {
+            if (dirty_count) dirty_overlay(r);
+            for (uint32_t k = 0; k < r->count; k++) {
+                cache_insert(r->lba + k, r->buf + (size_t)k * BLK_SECTOR_SIZE);
+            }
+        }
+        if (r == first && front) {
+            r->lba -= front;
+            r->buf -= (size_t)front * BLK_SECTOR_SIZE;
+            r->count += front;
+        }
+        blk_complete(r, status);
+        r = next;
+    }
+    return 1;
+}
+
+void blk_run(void) {
+    while (blk_step()) ;
+}
+
+int blk_read(uint64_t lba, uint32_t count, uint8_t *buf) {
+    BlkRequest req = { .lba = lba, .count = count, .buf = buf, .done = NULL, .ctx = NULL };
+    blk_submit(&req);
+    while (req.status == BLK_PENDING) {
+        blk_step();
+    }
+    return req.status;
+}
+
+int blk_attach(BlkDev *newdev) {
+    if (newdev == dev) return 0;
+    if (newdev->sector_size != BLK_SECTOR_SIZE) {
+        LOG(LOG_LEVEL_ERR, "blk: %s has %d-byte sectors, need %d", newdev->name, (int)newdev->sector_size, BLK_SECTOR_SIZE);
+        return -1;
+    }
+    // Queued reads and dirty sectors belong to the old device
+    blk_run();
+    if (blk_sync() < 0) return -1;
+    cache_clear();
+    dev = newdev;
+    head_lba = 0;
+    LOG(LOG_LEVEL_INFO, "blk: attached %s", dev->name);
+    return 0;
+}
+
+BlkDev *blk_device(void) {
+    return dev;
+}
+
+#if BLK_SELFTEST
+/////// SELF-TEST ////////////////////////////////////////
+// Streams through a made-up device the way fat_read does: a demand read,
+// then read-ahead of what follows it. The read-ahead has to reach the disk
+// and ride along with the demand reads, so there are fewer commands than
+// reads. Runs before any real device is attached and leaves none attached.
+
+#define BLK_TEST_READS 16
+#define BLK_TEST_LEN   8
+
+static uint32_t test_cmds;
+
+// Every byte of a sector holds the low byte of its LBA
+static int test_read(BlkDev *d, uint64_t lba, uint32_t count, uint8_t *buf) {
+    (void)d;
+    test_cmds++;
+    for (uint32_t k = 0; k < count; k++) {
+        memset(buf + (size_t)k * BLK_SECTOR_SIZE, (uint8_t)(lba + k), BLK_SECTOR_SIZE);
+    }
+    return 0;
+}
+
+void blk_selftest(void) {
+    static const BlkDevOps test_ops = { test_read, NULL, NULL };
+    static BlkDev test_dev = { "test", &test_ops, BLK_SECTOR_SIZE, 4096, NULL };
+    static uint8_t buf[BLK_TEST_LEN * BLK_SECTOR_SIZE];
+    if (dev || blk_attach(&test_dev) < 0) return;
+    test_cmds = 0;
+    for (int i = 0; i < BLK_TEST_READS; i++) {
+        uint64_t lba = 64 + (uint64_t)i * BLK_TEST_LEN;
+        assertf(blk_read(lba, BLK_TEST_LEN, buf) == 0);
+        assertf(buf[0] == (uint8_t)lba);
+        assertf(buf[sizeof buf - 1] == (uint8_t)(lba + BLK_TEST_LEN - 1));
+        blk_prefetch(lba + BLK_TEST_LEN, 2 * BLK_TEST_LEN);
+    }
+    blk_run();
+    BlkStats st;
+    blk_stats(&st);
+    LOG(LOG_LEVEL_INFO, "blk: self-test %d reads, %d commands, %8 sectors read ahead",
+        BLK_TEST_READS, (int)test_cmds, st.readahead);
+    assertf(st.readahead > 0);
+    assertf(test_cmds < BLK_TEST_READS);
+    cache_clear();
+    memset(&stats, 0, sizeof(stats));
+    dev = NULL;
+    head_lba = 0;
+}
+#endif
@@ -0,0 +1,67 @@
+#include "blkdev.h"
+#include "serial.h"
+#include "string.h"
+
+static BlkDev *devices[BLKDEV_MAX];
+static int device_count = 0;
+
+int blkdev_register(BlkDev *dev) {
+    if (device_count == BLKDEV_MAX) {
+        LOG(LOG_LEVEL_ERR, "blkdev: no room for %s", dev->name);
+        return -1;
+    }
+    devices[device_count] = dev;
+    LOG(LOG_LEVEL_INFO, "blkdev: %s, %8 sectors of %d bytes", dev->name, dev->sectors, (int)dev->sector_size);
+    return device_count++;
+}
+
+int blkdev_count(void) {
+    return device_count;
+}
+
+BlkDev *blkdev_get(int idx) {
+    return (idx >= 0 && idx < device_count) ? devices[idx] : NULL;
+}
+
+BlkDev *blkdev_find(const char *name) {
+    for (int i = 0; i < device_count; i++) {
+        if (str_eq(devices[i]->name, name)) return devices[i];
+    }
+    return NULL;
+}
+
+static int blkdev_check(BlkDev *dev, uint64_t lba, uint32_t count) {
+    if (!dev) return -1;
+    if (lba + count > dev->sectors || lba + count < lba) {
+        LOG(LOG_LEVEL_ERR, "blkdev: %s: %8+%8 past end (%8 sectors)", dev->name, lba, (uint64_t)count, dev->sectors);
+        return -1;
+    }
+    return 0;
+}
+
+int blkdev_read(BlkDev *dev, uint64_t lba, uint32_t count, uint8_t *buf) {
+    if (blkdev_check(dev, lba, count) < 0) return -1;
+    return dev->ops->read(dev, lba, count, buf);
+}
+
+int blkdev_write(BlkDev *dev, uint64_t lba, uint32_t count, const uint8_t *buf) {
+    if (blkdev_check(dev, lba, count) < 0) return -1;
+    if (!dev->ops->write) return -1;
+    return dev->ops->write(dev, lba, count, buf);
+}
+
+int blkdev_flush(BlkDev *dev) {
+    if (!dev) return -1;
+    return dev->ops->flush ? dev->ops->flush(dev) : 0;
+}
+
+void blkdev_name(BlkDev *dev, const char *prefix, int idx) {
+    size_t n = 0;
+    while (prefix[n] && n < sizeof(dev->name) - 3) {
+        dev->name[n] = prefix[n];
+        n++;
+    }
+    if (idx >= 10) dev->name[n++] = (char)('0' + idx / 10);
+    dev->name[n++] = (char)('0' + idx % 10);
+    dev->name[n] = '\0';
+}
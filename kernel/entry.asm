@@ -15,6 +15,10 @@
 %define CR0_PE      (1 << 0)        ; CR0.PE (protected mode) - already set by GRUB
 %define CR0_PG      (1 << 31)       ; CR0.PG (enable paging)
 %define CR4_PAE     (1 << 5)        ; CR4.PAE (Physical Address Extension) - required for long mode
+%define CR0_MP      (1 << 1)        ; CR0.MP (monitor coprocessor) - needed for SSE
+%define CR0_EM      (1 << 2)        ; CR0.EM (x87 emulation) - must be clear for SSE
+%define CR4_OSFXSR  (1 << 9)        ; CR4.OSFXSR - OS supports FXSAVE/FXRSTOR, enables SSE
+%define CR4_OSXMMEXCPT (1 << 10)    ; CR4.OSXMMEXCPT - unmasked SIMD FP exceptions raise #XM
 %define PAGE_P   0x001
 %define PAGE_RW  0x002
 %define PAGE_PS  0x080
@@ -362,6 +366,17 @@ long_mode_start:
     ; _stack_top is defined by the 64-bit linker script and points to highest stack address.
     mov rsp, _stack_top    ; set RSP to the top of the stack (stack grows downward)
 
+    ; ---------------- Enable SSE ----------------
+    ; SSE2 is architectural on x86-64, but the OS has to opt in before any
+    ; XMM instruction runs (gcc -O2 emits them, and string.c uses them).
+    mov rax, cr0
+    and rax, ~CR0_EM       ; no x87 emulation
+    or  rax, CR0_MP
+    mov cr0, rax
+    mov rax, cr4
+    or  rax, CR4_OSFXSR | CR4_OSXMMEXCPT
+    mov cr4, rax
+
     ; ---------- Debug: 'K' before calling kernel_main ----------
     mov al, 'K'
     mov dx, DBGPORT
@@ -2,7 +2,8 @@
 #include "fat.h"
 #include "serial.h"
 #include "types.h"
-#include "ata.h"
+#include "blk.h"
+#include "mem.h"
 #include "string.h"
 #include "framebuffer.h"
 #include "shell.h"
@@ -12,7 +13,7 @@
 int fs_parse_boot_sector(fat_bpb* bpb) {
     uint8_t buf[512];  
     // Temporary buffer to hold the raw boot sector (sector 0) from disk
-    ata_read_sector(0, buf);  
+    if (blk_read(0, 1, buf) < 0) return 0;
     // Read LBA 0 (boot sector) into buf — this contains the BPB (BIOS Parameter Block)
     // and possibly boot code. All FAT layout info comes from here.
     // --- Parse core BPB fields from fixed offsets in the boot sector ---
@@ -28,11 +29,27 @@ int fs_parse_boot_sector(fat_bpb* bpb) {
     // Max number of root directory entries (FAT12/16 only), from offset 0x11
     bpb->sectors_per_fat     = buf[22] | (buf[23] << 8);  
     // Sectors per FAT table (u16) — size of each FAT copy, from offset 0x16
+    bpb->root_cluster        = 0;
+    if (bpb->sectors_per_fat == 0) {
+        // FAT32 extended BPB: the 16-bit FAT size is 0 and the real one is
+        // the u32 at 0x24; the root directory is a cluster chain starting
+        // at the cluster in the u32 at 0x2C
+        bpb->sectors_per_fat = buf[36] | (buf[37] << 8) | (buf[38] << 16) | ((uint32_t)buf[39] << 24);
+        bpb->root_cluster    = buf[44] | (buf[45] << 8) | (buf[46] << 16) | ((uint32_t)buf[47] << 24);
+    }
+    bpb->total_sectors       = buf[19] | (buf[20] << 8);
+    // Volume size in sectors (u16) from offset 0x13; 0 means it needs the
+    // 32-bit field at offset 0x20 instead
+    if (bpb->total_sectors == 0) {
+        bpb->total_sectors = buf[32] | (buf[33] << 8) | (buf[34] << 16) | ((uint32_t)buf[35] << 24);
+    }
     // --- Calculate derived layout values ---
+    if (bpb->bytes_per_sector == 0) return 0;   // not a FAT boot sector
     uint32_t root_dir_sectors = ((bpb->root_entry_count * 32) + (bpb->bytes_per_sector - 1)) / bpb->bytes_per_sector;
     // Root directory size in sectors:
     // Each root entry is 32 bytes; multiply by entry count to get total bytes,
     // then divide by bytes/sector (rounding up) to get sector count.
+    // FAT32 has no fixed root region: the count is 0 and this comes out 0.
     bpb->root_start_lba = bpb->reserved_sectors + (bpb->num_fats * bpb->sectors_per_fat);
     // LBA where the root directory starts:
     // Skip reserved sectors + all FAT copies.
@@ -51,15 +68,16 @@ int fs_parse_boot_sector(fat_bpb* bpb) {
 int parse_dir_entry(const uint8_t* e, fat_dir_entry* out) {
     // Skip entries that are not valid files/directories:
     // e[0]:q == 0x00 → no more entries in this directory (end marker)
-    // e[11] == 0x0F → long file name (LFN) entry, not a short 8.3 entry
+    // e[11] == 0x0F → long file name (LFN) part; fat_dir_scan assembles those
     // e[0] == 0xE5 → deleted entry
-    if (e[0] == 0x00 || e[11] == 0x0F || e[0] == 0xE5) return 0;
+    // e[11] & 0x08 → volume label, not a file
+    if (e[0] == 0x00 || e[11] == 0x0F || e[0] == 0xE5 || (e[11] & 0x08)) return 0;
     // Extract the 8-character name field (offset 0x00–0x07)
     // Replace space padding with '\0' to terminate the string early
     for (int i = 0; i < 8; i++) {
         out->name[i] = (e[i] == ' ') ? '\0' : e[i];
-        sfprint("e[%d] = %c  i[%d] = %c\n", i, e[i], i, out->name[i]);
     }
+    if (e[0] == 0x05) out->name[0] = (char)0xE5; // 0xE5 as a real first byte is stored as 0x05
     out->name[8] = '\0'; // Ensure null-termination
     // Extract the 3-character extension field (offset 0x08–0x0A)
     // Replace space padding with '\0'
@@ -73,269 +91,882 @@ int parse_dir_entry(const uint8_t* e, fat_dir_entry* out) {
     // First cluster number (offset 0x1A–0x1B)
     // FAT12/16: this is the full cluster number
     // FAT32: this is the low word; high word is at offset 0x14–0x15
-    out->first_cluster = e[26] | (e[27] << 8);
+    // (FAT12/16 leave the high word 0; callers that know the type mask it)
+    out->first_cluster = (e[26] | (e[27] << 8)) | ((uint32_t)(e[20] | (e[21] << 8)) << 16);
     // File size in bytes (offset 0x1C–0x1F), little-endian
     out->size = e[28] | (e[29] << 8) | (e[30] << 16) | (e[31] << 24);
+    // Build the "NAME.EXT" form once; lookups and listings use it as is
+    char* full = out->full;
+    for (int i = 0; out->name[i]; i++) *full++ = out->name[i];
+    if (out->ext[0]) {
+        *full++ = '.';
+        for (int i = 0; out->ext[i]; i++) *full++ = out->ext[i];
+    }
+    *full = '\0';
+    LOG(LOG_LEVEL_TRACE, "fat: entry %s", out->full);
     // Return 1 to indicate a valid short directory entry was parsed
-    char full[13]; // 8 chars for name + 1 dot + 3 chars for ext + null terminator
-    int name_len = custom_strlen(out->name);
-    int ext_len = custom_strlen(out->ext);
-    for (int i = 0; i < name_len; i++) {
-                full[i] = out->name[i];
-    }
-    if (ext_len > 0) {
-        full[name_len] = '.';
-        for (int i = 0; i < 3; i++) {
-            full[i + (name_len +1)] = out->ext[i];
+    return 1;
+}
+
+
+/////// VOLUME ////////////////////////////////////////
+// The filesystem on the block layer's device is mounted once: the BPB is
+// parsed and the whole FAT is decoded into an array of 32-bit entries, so
+// following a chain is an array lookup instead of a sector read per link.
+// It's mounted again if the block layer moves to a different device.
+
+static fat_fs volume;
+static int volume_mounted = 0;
+
+// FAT sectors read per request while loading FAT16/FAT32 tables
+#define FAT_LOAD_SECTORS 64
+
+// Raw 12-bit entry for 'cluster' from an in-memory copy of the FAT
+static uint32_t fat12_entry(const uint8_t* fat, uint32_t cluster) {
+    // Each FAT12 entry is 12 bits (1.5 bytes), so to find the byte offset:
+    // multiply the cluster number by 1.5 → (cluster * 3) / 2
+    uint32_t off = (cluster * 3) / 2;
+    uint16_t pair = fat[off] | (fat[off + 1] << 8);
+    // Odd clusters take the high 12 bits of the pair, even ones the low 12
+    return (cluster & 1) ? (pair >> 4) : (pair & 0x0FFF);
+}
+
+// Entry 'i' of a raw FAT buffer. FAT32 entries are 28 bits; the top four
+// are reserved and must be ignored.
+static uint32_t fat_raw_entry(enum FATType type, const uint8_t* raw, uint32_t i) {
+    switch (type) {
+        case FAT12: return fat12_entry(raw, i);
+        case FAT16: return raw[i * 2] | (raw[i * 2 + 1] << 8);
+        default:    return (raw[i * 4] | (raw[i * 4 + 1] << 8) | (raw[i * 4 + 2] << 16) |
+                            ((uint32_t)raw[i * 4 + 3] << 24)) & 0x0FFFFFFF;
+    }
+}
+
+int fat_mount(fat_fs* fs) {
+    fs->dev = blk_device();
+    if (!fs->dev || !fs_parse_boot_sector(&fs->bpb)) return -1;
+    fat_bpb* bpb = &fs->bpb;
+    if (bpb->bytes_per_sector != 512 || !bpb->sectors_per_cluster || !bpb->num_fats ||
+        !bpb->sectors_per_fat || bpb->total_sectors <= bpb->data_start_lba) {
+        LOG(LOG_LEVEL_ERR, "fat: %s has no usable FAT volume", fs->dev->name);
+        return -1;
+    }
+    // The FAT type follows from the number of data clusters alone
+    fs->clusters = (bpb->total_sectors - bpb->data_start_lba) / bpb->sectors_per_cluster;
+    fs->type = (fs->clusters < 4085) ? FAT12 : (fs->clusters < 65525) ? FAT16 : FAT32;
+    // A FAT too short to hold an entry per cluster limits the usable clusters
+    uint32_t fat_bytes = bpb->sectors_per_fat * 512;
+    uint32_t fit = (fs->type == FAT12) ? (fat_bytes - 1) * 2 / 3
+                 : fat_bytes / ((fs->type == FAT16) ? 2 : 4);
+    if (fit <= 2) return -1;
+    if (fs->clusters + 2 > fit) fs->clusters = fit - 2;
+    if ((fs->type == FAT32) ? !fat_valid_cluster(fs, bpb->root_cluster) : !bpb->root_entry_count) {
+        LOG(LOG_LEVEL_ERR, "fat: %s has no root directory", fs->dev->name);
+        return -1;
+    }
+
+    // FAT12 entries straddle sector boundaries, so its table (a few KiB at
+    // most) is loaded whole; FAT16/32 tables are streamed in pieces.
+    uint32_t chunk = (fs->type == FAT12) ? bpb->sectors_per_fat : FAT_LOAD_SECTORS;
+    uint32_t per_sector = (fs->type == FAT16) ? 256 : 128;
+    size_t raw_frames = ((size_t)chunk * 512 + PAGE_SIZE - 1) / PAGE_SIZE;
+    fs->fat_frames = ((size_t)(fs->clusters + 2) * sizeof(uint32_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint8_t* raw = (uint8_t*)(uintptr_t)alloc_frames(raw_frames);
+    fs->fat = (uint32_t*)(uintptr_t)alloc_frames(fs->fat_frames);
+    if (!raw || !fs->fat) goto fail;
+
+    // Anything that doesn't lead to another data cluster (end of chain, bad
+    // cluster, a free or out-of-range link) decodes to FAT_EOC
+    uint32_t entries = fs->clusters + 2;
+    uint32_t c = 0;
+    for (uint32_t s = 0; c < entries; s += chunk) {
+        uint32_t n = (bpb->sectors_per_fat - s < chunk) ? bpb->sectors_per_fat - s : chunk;
+        if (blk_read(bpb->reserved_sectors + s, n, raw) < 0) goto fail;
+        uint32_t last = (fs->type == FAT12) ? entries : (s + n) * per_sector;
+        if (last > entries) last = entries;
+        for (; c < last; c++) {
+            uint32_t next = fat_raw_entry(fs->type, raw, (fs->type == FAT12) ? c : c - s * per_sector);
+            fs->fat[c] = fat_valid_cluster(fs, next) ? next : FAT_EOC;
         }
-        full[(name_len + 1) + 3] = '\0';
-    } else {
-        full[name_len] = '\0';
     }
-    sfprint("Filename: %s\n", full);
+    free_frames((uint64_t)(uintptr_t)raw, raw_frames);
+    LOG(LOG_LEVEL_INFO, "fat: mounted %s, FAT%d, %d clusters of %d sectors", fs->dev->name,
+        (fs->type == FAT12) ? 12 : (fs->type == FAT16) ? 16 : 32,
+        (int)fs->clusters, (int)bpb->sectors_per_cluster);
+    return 0;
+
+fail:
+    LOG(LOG_LEVEL_ERR, "fat: can't load the FAT of %s", fs->dev->name);
+    if (raw) free_frames((uint64_t)(uintptr_t)raw, raw_frames);
+    if (fs->fat) free_frames((uint64_t)(uintptr_t)fs->fat, fs->fat_frames);
+    fs->fat = NULL;
+    return -1;
+}
+
+static void fat_dcache_clear(void);
+static void fat_path_clear(void);
+
+void fat_unmount(fat_fs* fs) {
+    fat_dcache_clear();
+    fat_path_clear();
+    if (fs->fat) free_frames((uint64_t)(uintptr_t)fs->fat, fs->fat_frames);
+    fs->fat = NULL;
+    fs->dev = NULL;
+}
+
+fat_fs* fat_volume(void) {
+    BlkDev* dev = blk_device();
+    if (volume_mounted && volume.dev == dev) return &volume;
+    if (volume_mounted) {
+        fat_unmount(&volume);
+        volume_mounted = 0;
+    }
+    if (fat_mount(&volume) < 0) return NULL;
+    volume_mounted = 1;
+    return &volume;
+}
+
+uint32_t fat_next_cluster(const fat_fs* fs, uint32_t cluster) {
+    return fat_valid_cluster(fs, cluster) ? fs->fat[cluster] : FAT_EOC;
+}
+
+/////// DIRECTORY CACHE ////////////////////////////////////////
+// Directories are read and parsed once into an array of entries, in disk
+// order for listing, with a hash over both the "NAME.EXT" and the long name
+// of each entry for lookups, so either finds it in one probe. Up to
+// FAT_DCACHE_DIRS directories stay cached, least recently used replaced
+// first. A cached directory is dropped when the block layer has seen a
+// write since it was read, and all of them on unmount.
+
+#define FAT_DCACHE_DIRS 8
+
+typedef struct {
+    int used;
+    uint32_t cluster;        // directory's first cluster; 0 = fixed FAT12/16 root
+    uint32_t gen;            // blk_write_generation() when it was read
+    uint32_t stamp;          // last use, for LRU replacement
+    uint32_t count;
+    uint32_t mask;           // hash buckets - 1
+    fat_dir_entry* ent;
+    uint32_t* lname;         // each entry's long name in 'names', or FAT_NO_LFN
+    char* names;             // long names, UTF-8, NUL-terminated back to back
+    uint32_t names_len;
+    // Hash nodes: node i is entry i's short name, node count + i its long name
+    int32_t* chain;          // next node in the same bucket, -1 ends
+    int32_t* bucket;
+} fat_dcache;
+
+#define FAT_NO_LFN 0xFFFFFFFF
+
+static fat_dcache dcache[FAT_DCACHE_DIRS];
+static uint32_t dcache_clock = 0;
+
+// Names match case-insensitively. Only ASCII is folded; other characters
+// in a long name have to match exactly.
+static char fat_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+// FNV-1a over at most 'n' bytes of 'name', case folded
+static uint32_t fat_name_hash(const char* name, size_t n) {
+    uint32_t h = 2166136261u;
+    while (n-- && *name) {
+        h ^= (uint8_t)fat_upper(*name++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Compare at most 'n' bytes of two names, case folded
+static int fat_name_eq(const char* a, const char* b, size_t n) {
+    for (; n > 0; n--, a++, b++) {
+        if (fat_upper(*a) != fat_upper(*b)) return 0;
+        if (!*a) break;
+    }
     return 1;
 }
 
+static void fat_dcache_drop(fat_dcache* d) {
+    if (d->ent) tfree(d->ent);
+    if (d->lname) tfree(d->lname);
+    if (d->names) tfree(d->names);
+    if (d->chain) tfree(d->chain);
+    if (d->bucket) tfree(d->bucket);
+    d->ent = NULL;
+    d->lname = NULL;
+    d->names = NULL;
+    d->chain = NULL;
+    d->bucket = NULL;
+    d->used = 0;
+}
 
-int find_root_entry(const fat_bpb* bpb, const char* name83, fat_dir_entry* out) {
-    uint32_t root_dir_sectors =
-        ((bpb->root_entry_count * 32) + (bpb->bytes_per_sector - 1)) / bpb->bytes_per_sector;
-    uint8_t sector[512]; // Temporary buffer for one sector of directory entries
+static void fat_dcache_clear(void) {
+    for (int i = 0; i < FAT_DCACHE_DIRS; i++) {
+        if (dcache[i].used) fat_dcache_drop(&dcache[i]);
+    }
+}
+
+// A directory holds at most 65536 entries; stop there on a chain that loops
+#define FAT_DIR_MAX_SECTORS (65536 * 32 / 512)
+
+// Position in a directory being read sector by sector. Cluster 0 is the
+// FAT12/16 root, a fixed region after the FATs; any other directory, the
+// FAT32 root included, is an ordinary cluster chain.
+typedef struct {
+    uint32_t cluster;
+    uint32_t sector;         // within the cluster, or the whole root region
+} fat_dir_pos;
 
-    // Loop through each sector of the root directory
-    for (uint32_t s = 0; s < root_dir_sectors; s++) {
-        //sfprint("loop %8\n", s);
-        // Read the current root directory sector from disk
-        ata_read_sector(bpb->root_start_lba + s, sector);
-        sfprint("Sector read: %8\n", bpb->root_start_lba + s);
+// LBA of the directory's next sector, or 0 past its end. The chain is
+// followed one FAT entry per cluster boundary.
+static uint32_t fat_dir_next(const fat_fs* fs, fat_dir_pos* p) {
+    const fat_bpb* bpb = &fs->bpb;
+    if (p->cluster == 0) {
+        uint32_t lba = bpb->root_start_lba + p->sector++;
+        return (lba < bpb->data_start_lba) ? lba : 0;
+    }
+    if (p->sector == bpb->sectors_per_cluster) {
+        p->cluster = fat_next_cluster(fs, p->cluster);
+        p->sector = 0;
+    }
+    if (!fat_valid_cluster(fs, p->cluster)) return 0;
+    return fat_cluster_lba(fs, p->cluster) + p->sector++;
+}
+
+/////// LONG NAMES ////////////////////////////////////////
+// A long name is kept in up to 20 entries with attr 0x0F just before its
+// short entry, last part first. Each part holds 13 UCS-2 characters, a
+// sequence number (0x40 on the last part) and a checksum of the short
+// name it belongs to. The parts are collected as the directory streams
+// past; the name is only taken when every part arrived in order and the
+// checksum matches the short entry that follows. Anything else (orphaned
+// or deleted parts, a short entry renamed by an LFN-unaware system) leaves
+// just the 8.3 name.
+
+#define FAT_LFN_PARTS 20
+
+typedef struct {
+    uint16_t ucs[FAT_LFN_PARTS * 13];
+    uint8_t checksum;
+    uint8_t parts;           // parts in the name being collected, 0 = none
+    uint8_t next;            // sequence number expected next, 0 once complete
+} fat_lfn;
+
+// Where the 13 characters of a part sit in its entry
+static const uint8_t lfn_char_offset[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+static void fat_lfn_feed(fat_lfn* l, const uint8_t* e) {
+    uint8_t seq = e[0] & 0x1F;
+    if (e[0] & 0x40) {
+        // Last part: starts a new name
+        if (seq == 0 || seq > FAT_LFN_PARTS) {
+            l->parts = 0;
+            return;
+        }
+        l->parts = seq;
+        l->checksum = e[13];
+    } else if (!l->parts || seq == 0 || seq != l->next || e[13] != l->checksum) {
+        l->parts = 0;
+        return;
+    }
+    uint16_t* out = &l->ucs[(seq - 1) * 13];
+    for (int i = 0; i < 13; i++) {
+        out[i] = e[lfn_char_offset[i]] | (e[lfn_char_offset[i] + 1] << 8);
+    }
+    l->next = seq - 1;
+}
+
+static uint8_t fat_lfn_checksum(const uint8_t* e) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + e[i]);
+    }
+    return sum;
+}
 
+// Finish the name collected for short entry 'e' as UTF-8 in 'out'.
+// Returns its length, or 0 if 'e' has no valid long name.
+static uint32_t fat_lfn_finish(fat_lfn* l, const uint8_t* e, char out[FAT_NAME_MAX]) {
+    uint32_t parts = l->parts;
+    l->parts = 0;
+    if (!parts || l->next != 0 || l->checksum != fat_lfn_checksum(e)) return 0;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < parts * 13; i++) {
+        uint32_t c = l->ucs[i];
+        if (c == 0x0000 || c == 0xFFFF) break;   // terminator, then padding
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < parts * 13 &&
+            l->ucs[i + 1] >= 0xDC00 && l->ucs[i + 1] < 0xE000) {
+            // Surrogate pair
+            c = 0x10000 + ((c - 0xD800) << 10) + (l->ucs[++i] - 0xDC00);
+        } else if (c >= 0xD800 && c < 0xE000) {
+            c = '?';
+        }
+        uint32_t len = (c < 0x80) ? 1 : (c < 0x800) ? 2 : (c < 0x10000) ? 3 : 4;
+        if (n + len >= FAT_NAME_MAX) return 0;   // too long for a name; keep 8.3
+        if (len == 1) {
+            out[n++] = (char)c;
+            continue;
+        }
+        out[n++] = (char)((len == 2 ? 0xC0 : len == 3 ? 0xE0 : 0xF0) | (c >> (6 * (len - 1))));
+        for (uint32_t k = len - 1; k > 0; k--) {
+            out[n++] = (char)(0x80 | ((c >> (6 * (k - 1))) & 0x3F));
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Parse a directory's entries, and the long names in front of them, into
+// 'd'. With d->ent NULL the entries are only counted and d->names_len
+// worked out, to size the arrays for a second pass.
+// Returns the count, or -1 on a read error.
+static int fat_dir_scan(const fat_fs* fs, uint32_t cluster, fat_dcache* d) {
+    uint8_t sector[512]; // Temporary buffer for one sector of directory entries
+    fat_dir_entry ent;
+    fat_lfn lfn;
+    char name[FAT_NAME_MAX];
+    fat_dir_pos pos = { cluster, 0 };
+    uint32_t lba;
+    int n = 0;
+    lfn.parts = 0;
+    d->names_len = 0;
+    for (uint32_t s = 0; s < FAT_DIR_MAX_SECTORS && (lba = fat_dir_next(fs, &pos)) != 0; s++) {
+        if (blk_read(lba, 1, sector) < 0) return -1;
         for (int i = 0; i < 512; i += 32) {
-            if (!parse_dir_entry(sector + i, out)) {
+            const uint8_t* e = sector + i;
+            if (e[0] == 0x00) return n;   // end of directory
+            if (e[11] == 0x0F && e[0] != 0xE5) {
+                fat_lfn_feed(&lfn, e);
                 continue;
-            }    
-            char full[13]; // 8 chars for name + 1 dot + 3 chars for ext + null terminator
-            int name_len = custom_strlen(out->name);
-            int ext_len = custom_strlen(out->ext);
-            for (int i = 0; i < name_len; i++) {
-                full[i] = out->name[i];
             }
-            if (ext_len > 0) {
-                full[name_len] = '.';
-                for (int i = 0; i < 3; i++) {
-                    full[i + (name_len +1)] = out->ext[i];
-                }
-                full[(name_len + 1) + 3] = '\0';
-            } else {
-                full[name_len] = '\0';
+            if (!parse_dir_entry(e, &ent)) {
+                lfn.parts = 0;
+                continue;
+            }
+            // The high cluster word is reserved on FAT12/16
+            if (fs->type != FAT32) ent.first_cluster &= 0xFFFF;
+            uint32_t len = fat_lfn_finish(&lfn, e, name);
+            if (d->ent) {
+                d->ent[n] = ent;
+                d->lname[n] = len ? d->names_len : FAT_NO_LFN;
+                if (len) memcpy(d->names + d->names_len, name, len + 1);
             }
-            //sfprint("FULL: %s\n", full);
-            sfprint("%s.%s\n", out->name, out->ext);
-            if (cst_strcmp(full, name83) == 1)
-                return 1; // Found the file — 'out' now contains its metadata
+            if (len) d->names_len += len + 1;
+            n++;
         }
     }
-    // File not found in the root directory
-    sfprint("file '%s' not found\n", name83);
+    return n;
+}
+
+static void fat_dcache_index(fat_dcache* d, int32_t node, const char* name) {
+    uint32_t b = fat_name_hash(name, FAT_NAME_MAX) & d->mask;
+    d->chain[node] = d->bucket[b];
+    d->bucket[b] = node;
+}
+
+static int fat_dcache_load(const fat_fs* fs, uint32_t cluster, fat_dcache* d) {
+    // Count first, then fill; the second pass is served by the sector cache
+    d->ent = NULL;
+    int count = fat_dir_scan(fs, cluster, d);
+    if (count < 0) return -1;
+    uint32_t names_len = d->names_len;
+    uint32_t buckets = 16;
+    while (buckets < 2 * (uint32_t)count) buckets <<= 1;
+    d->ent = thralloc((count ? count : 1) * sizeof(fat_dir_entry));
+    d->lname = thralloc((count ? count : 1) * sizeof(uint32_t));
+    d->names = thralloc(names_len ? names_len : 1);
+    d->chain = thralloc((count ? 2 * count : 1) * sizeof(int32_t));
+    d->bucket = thralloc(buckets * sizeof(int32_t));
+    if (!d->ent || !d->lname || !d->names || !d->chain || !d->bucket ||
+        fat_dir_scan(fs, cluster, d) != count || d->names_len != names_len) {
+        fat_dcache_drop(d);
+        return -1;
+    }
+    d->used = 1;
+    d->cluster = cluster;
+    d->count = count;
+    d->mask = buckets - 1;
+    for (uint32_t b = 0; b < buckets; b++) d->bucket[b] = -1;
+    for (int i = 0; i < count; i++) {
+        fat_dcache_index(d, i, d->ent[i].full);
+        if (d->lname[i] != FAT_NO_LFN) fat_dcache_index(d, count + i, d->names + d->lname[i]);
+    }
     return 0;
 }
 
-uint16_t fat12_get_next_cluster(uint16_t cluster, const fat_bpb* bpb) {
-    // --- Calculate where in the FAT this cluster's entry lives ---
-    // Each FAT12 entry is 12 bits (1.5 bytes), so to find the byte offset:
-    // multiply the cluster number by 1.5 → (cluster * 3) / 2
-    uint32_t fat_offset = (cluster * 3) / 2;
-    // Convert that byte offset into an absolute sector number within the FAT area:
-    // Start at the first FAT sector (after reserved sectors), then add the sector offset
-    uint32_t fat_sector = bpb->reserved_sectors + (fat_offset / 512);
-    // Offset within that sector where the 12-bit entry starts
-    uint32_t ent_offset = fat_offset % 512;
-    // --- Read the FAT sector containing this entry ---
-    uint8_t sec[512];
-    ata_read_sector(fat_sector, sec);
-    // --- Extract the 12-bit value ---
-    uint16_t next;
-    if (cluster & 1) {
-        // Odd cluster: the 12 bits start in the high nibble of the first byte
-        // and continue into the next byte
-        //
-        // Layout for odd cluster N:
-        //   byte0: xxxxHHHH  (low nibble belongs to previous cluster)
-        //   byte1: HHHHHHHH  (high byte)
-        //
-        // Shift right to drop the previous cluster's bits, then combine
-        next = ((sec[ent_offset] >> 4) | (sec[ent_offset + 1] << 4)) & 0x0FFF;
-    } else {
-        // Even cluster: the 12 bits start at the low nibble of the first byte
-        // and continue into the low nibble of the next byte
-        //
-        // Layout for even cluster N:
-        //   byte0: LLLLLLLL  (low byte)
-        //   byte1: xxxxLLLL  (high nibble)
-        //
-        // Mask off the high nibble of byte1 to keep only our cluster's bits
-        next = (sec[ent_offset] | ((sec[ent_offset + 1] & 0x0F) << 8)) & 0x0FFF;
-    }
-    // Return the next cluster number in the chain (0xFF8+ means end-of-chain)
-    return next;
-}
-
-int fs_read_file(const char* name83, uint8_t* out, size_t maxlen) {
-    fat_bpb bpb;
-    fs_parse_boot_sector(&bpb);
-    // Parse the boot sector into a BPB struct so we know the filesystem layout:
-    // bytes/sector, sectors/cluster, reserved sectors, FAT size, root/data LBAs, etc.
+// The cached form of the directory at 'cluster', reading it if needed
+static fat_dcache* fat_dcache_get(const fat_fs* fs, uint32_t cluster) {
+    uint32_t gen = blk_write_generation();
+    fat_dcache* victim = NULL;
+    for (int i = 0; i < FAT_DCACHE_DIRS; i++) {
+        fat_dcache* d = &dcache[i];
+        if (d->used && d->cluster == cluster) {
+            if (d->gen == gen) {
+                d->stamp = ++dcache_clock;
+                return d;
+            }
+            victim = d;   // stale: reread into the same slot
+            break;
+        }
+        if (!victim || (victim->used && (!d->used || d->stamp < victim->stamp))) victim = d;
+    }
+    if (victim->used) fat_dcache_drop(victim);
+    if (fat_dcache_load(fs, cluster, victim) < 0) return NULL;
+    victim->gen = gen;
+    victim->stamp = ++dcache_clock;
+    return victim;
+}
+
+static uint32_t fat_root_dir(const fat_fs* fs) {
+    return (fs->type == FAT32) ? fs->bpb.root_cluster : 0;
+}
+
+int fat_dir_lookup(const fat_fs* fs, uint32_t dir, const char* name, fat_dir_entry* out) {
+    fat_dcache* d = fat_dcache_get(fs, dir);
+    if (!d) return 0;
+    for (int32_t k = d->bucket[fat_name_hash(name, FAT_NAME_MAX) & d->mask]; k >= 0; k = d->chain[k]) {
+        uint32_t i = ((uint32_t)k < d->count) ? (uint32_t)k : k - d->count;
+        const char* cand = ((uint32_t)k < d->count) ? d->ent[i].full : d->names + d->lname[i];
+        if (fat_name_eq(cand, name, FAT_NAME_MAX)) {
+            *out = d->ent[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/////// PATHS ////////////////////////////////////////
+// Paths are '/'-separated, relative to a current directory unless they start
+// with '/'. They're made canonical first (absolute, "." and ".." folded
+// away), so a directory always has one spelling up to case. Each directory
+// resolved on a walk is remembered under that spelling in a direct-mapped
+// table, and the next walk starts from the longest remembered prefix instead
+// of the root. Entries go stale on any block write, like the directory
+// cache, and are all dropped on unmount.
+
+#define FAT_PATH_SLOTS 64
+
+typedef struct {
+    uint32_t len;            // 0 = empty
+    uint32_t cluster;        // the directory's first cluster
+    uint32_t gen;            // blk_write_generation() when it was resolved
+    char path[FAT_PATH_MAX];
+} fat_path_slot;
+
+static fat_path_slot path_memo[FAT_PATH_SLOTS];
+
+static void fat_path_clear(void) {
+    for (int i = 0; i < FAT_PATH_SLOTS; i++) path_memo[i].len = 0;
+}
+
+static fat_path_slot* fat_path_slot_for(const char* path, uint32_t len) {
+    return &path_memo[fat_name_hash(path, len) % FAT_PATH_SLOTS];
+}
+
+static int fat_path_recall(const char* path, uint32_t len, uint32_t* cluster) {
+    const fat_path_slot* p = fat_path_slot_for(path, len);
+    if (p->len != len || p->gen != blk_write_generation() || !fat_name_eq(p->path, path, len)) return 0;
+    *cluster = p->cluster;
+    return 1;
+}
+
+static void fat_path_remember(const char* path, uint32_t len, uint32_t cluster) {
+    fat_path_slot* p = fat_path_slot_for(path, len);
+    memcpy(p->path, path, len);
+    p->len = len;
+    p->cluster = cluster;
+    p->gen = blk_write_generation();
+}
+
+int fat_path_join(const char* cwd, const char* path, char out[FAT_PATH_MAX]) {
+    uint32_t n = 0;
+    out[n++] = '/';
+    // An absolute path ignores cwd; otherwise both are walked in turn
+    const char* parts[2] = { (path[0] == '/') ? "" : cwd, path };
+    for (int i = 0; i < 2; i++) {
+        const char* p = parts[i];
+        while (*p) {
+            while (*p == '/') p++;
+            const char* c = p;
+            uint32_t len = 0;
+            while (c[len] && c[len] != '/') len++;
+            p += len;
+            if (len == 0 || (len == 1 && c[0] == '.')) continue;
+            if (len == 2 && c[0] == '.' && c[1] == '.') {
+                // Drop the last component; ".." of the root is the root
+                while (n > 1 && out[n - 1] != '/') n--;
+                if (n > 1) n--;
+                continue;
+            }
+            if (n > 1) out[n++] = '/';
+            if (n + len >= FAT_PATH_MAX) return -1;
+            memcpy(out + n, c, len);
+            n += len;
+        }
+    }
+    out[n] = '\0';
+    return 0;
+}
+
+// First cluster of the directory at the canonical path path[0..len), with
+// len 0 meaning the root
+static int fat_walk_dir(const fat_fs* fs, const char* path, uint32_t len, uint32_t* out) {
+    uint32_t cluster = fat_root_dir(fs);
+    uint32_t pos = 0;        // end of the prefix resolved so far
+    // Back off a component at a time to the longest remembered prefix
+    for (uint32_t end = len; end > 0; ) {
+        if (fat_path_recall(path, end, &cluster)) {
+            pos = end;
+            break;
+        }
+        while (path[--end] != '/') ;
+    }
+    // Then walk down from there, remembering every directory passed
+    while (pos < len) {
+        uint32_t start = pos + 1;
+        uint32_t end = start;
+        while (end < len && path[end] != '/') end++;
+        char name[FAT_NAME_MAX];
+        if (end - start >= FAT_NAME_MAX) return 0;
+        memcpy(name, path + start, end - start);
+        name[end - start] = '\0';
+        fat_dir_entry ent;
+        if (!fat_dir_lookup(fs, cluster, name, &ent) || !(ent.attr & FAT_ATTR_DIR)) return 0;
+        cluster = ent.first_cluster;
+        pos = end;
+        fat_path_remember(path, pos, cluster);
+    }
+    *out = cluster;
+    return 1;
+}
+
+int fat_resolve(const char* cwd, const char* path, fat_dir_entry* out) {
+    fat_fs* fs = fat_volume();
+    char abs[FAT_PATH_MAX];
+    if (!fs || fat_path_join(cwd, path, abs) < 0) return 0;
+    uint32_t len = custom_strlen(abs);
+    if (len == 1) {
+        // The root has no entry of its own
+        memset(out, 0, sizeof(*out));
+        out->full[0] = '/';
+        out->attr = FAT_ATTR_DIR;
+        out->first_cluster = fat_root_dir(fs);
+        return 1;
+    }
+    uint32_t slash = len;
+    while (abs[--slash] != '/') ;
+    uint32_t dir;
+    if (!fat_walk_dir(fs, abs, slash, &dir)) return 0;
+    if (!fat_dir_lookup(fs, dir, abs + slash + 1, out)) {
+        LOG(LOG_LEVEL_DEBUG, "path '%s' not found", abs);
+        return 0;
+    }
+    if (out->attr & FAT_ATTR_DIR) fat_path_remember(abs, len, out->first_cluster);
+    return 1;
+}
+
+int fat_chdir(ShellContext* shell, const char* path) {
+    char abs[FAT_PATH_MAX];
     fat_dir_entry ent;
-    if (!find_root_entry(&bpb, name83, &ent)) return -1;
-    // Search the root directory for the given 8.3 filename.
-    // If found, 'ent' will contain its starting cluster and file size.
-    // If not found, return -1 to indicate error.
-    uint16_t cluster = ent.first_cluster;
-    // The first cluster number where this file's data begins.
-    size_t remaining = ent.size;
-    // Number of bytes left to read from the file.
-    size_t written = 0;
-    // Number of bytes successfully copied into 'out'.
-    uint8_t sec[512];
-    // Temporary buffer for reading one sector from disk.
-    // Walk the FAT chain until we hit an end-of-chain marker or run out of bytes to read.
-    while (cluster < 0xFF8 && remaining > 0) {
-        // Convert cluster number to absolute LBA:
-        // Data region starts at data_start_lba, and cluster #2 is the first data cluster.
-        uint32_t lba = bpb.data_start_lba + (cluster - 2) * bpb.sectors_per_cluster;
-        // Read all sectors in this cluster (usually 1 for floppies, but BPB defines it)
-        for (uint8_t s = 0; s < bpb.sectors_per_cluster && remaining > 0; s++) {
-            ata_read_sector(lba + s, sec);
-            // Read one sector from disk into 'sec'.
-            size_t chunk = (remaining < 512) ? remaining : 512;
-            // Only copy as many bytes as remain in the file (last sector may be partial).
-            for (size_t i = 0; i < chunk && written < maxlen; i++)
-                out[written++] = sec[i];
-            // Copy from sector buffer into output buffer.
-            remaining -= chunk;
-            // Reduce remaining byte count.
+    if (fat_path_join(shell->cwd, path, abs) < 0) return -1;
+    if (!fat_resolve("/", abs, &ent) || !(ent.attr & FAT_ATTR_DIR)) return -1;
+    memcpy(shell->cwd, abs, custom_strlen(abs) + 1);
+    return 0;
+}
+
+int fat_list_dir(const char* cwd, const char* path, ShellContext *shell) {
+    fat_fs* fs = fat_volume();
+    fat_dir_entry dir;
+    if (!fs || !fat_resolve(cwd, path, &dir) || !(dir.attr & FAT_ATTR_DIR)) return -1;
+    fat_dcache* d = fat_dcache_get(fs, dir.first_cluster);
+    if (!d) return -1;
+    for (uint32_t i = 0; i < d->count; i++) {
+        const fat_dir_entry* e = &d->ent[i];
+        if (str_eq(e->full, ".") || str_eq(e->full, "..")) continue;
+        // Show the long name where there is one
+        const char* name = (d->lname[i] != FAT_NO_LFN) ? d->names + d->lname[i] : e->full;
+        fb_draw_stringsh(name, custom_strlen((char*)name), FG, BG, shell);
+        if (e->attr & FAT_ATTR_DIR) fb_draw_stringsh("/", 1, FG, BG, shell);
+        fb_draw_stringsh("\n", 1, FG, BG, shell);
+    }
+    return 0;
+}
+
+// File data reads are queued in batches of up to FAT_READ_BATCH requests and
+// handed to the block layer together, so it can sort and merge them.
+#define FAT_READ_BATCH 16
+
+typedef struct {
+    int pending;
+    int failed;
+} fat_read_batch;
+
+static void fat_read_done(BlkRequest* req, int status) {
+    fat_read_batch* b = req->ctx;
+    if (status < 0) b->failed = 1;
+    b->pending--;
+}
+
+static void fat_queue(BlkRequest* req, uint32_t lba, uint32_t count, uint8_t* buf, fat_read_batch* b) {
+    req->lba = lba;
+    req->count = count;
+    req->buf = buf;
+    req->done = fat_read_done;
+    req->ctx = b;
+    b->pending++;
+}
+
+static int fat_flush(BlkRequest* reqs, int n, fat_read_batch* b) {
+    for (int i = 0; i < n; i++) {
+        blk_submit(&reqs[i]);
+    }
+    // Only until this batch is in; queued read-ahead is left to go out
+    // with the next batch or from the idle loop
+    while (b->pending > 0) {
+        blk_step();
+    }
+    return b->failed ? -1 : 0;
+}
+
+// Split the chain starting at 'first' into runs of physically consecutive
+// clusters. With out == NULL the extents are only counted. At most 'max'
+// clusters are followed, which also stops a corrupt chain that loops.
+static uint32_t fat_chain_extents(const fat_fs* fs, uint32_t first, uint32_t max, fat_extent* out) {
+    uint32_t n = 0;
+    uint32_t cluster = first;
+    while (max > 0 && fat_valid_cluster(fs, cluster)) {
+        uint32_t start = cluster;
+        uint32_t len = 1;
+        uint32_t next = fat_next_cluster(fs, cluster);
+        while (next == cluster + 1 && len < max) {
+            cluster = next;
+            len++;
+            next = fat_next_cluster(fs, cluster);
+        }
+        if (out) {
+            out[n].start = start;
+            out[n].len = len;
         }
-        // Look up the next cluster in the FAT table.
-        // For FAT12, this involves unpacking a 12-bit entry.
-        cluster = fat12_get_next_cluster(cluster, &bpb);
+        n++;
+        max -= len;
+        cluster = next;
     }
-    // Return the number of bytes actually written to 'out'.
-    return (int)written;
+    return n;
 }
 
-int fs_list_files(ShellContext *shell) {
-    sfprint("\n\nListing files\n");
-    fat_bpb bpb;
-    fs_parse_boot_sector(&bpb);
-    // Parse the boot sector into a BPB struct so we know the filesystem layout:
-    // bytes/sector, sectors/cluster, reserved sectors, FAT size, root/data LBAs, etc.
+int fat_open(const char* path, fat_file* f) {
+    f->fs = fat_volume();
+    if (!f->fs) return -1;
+    // The mounted volume knows the filesystem layout: bytes/sector,
+    // sectors/cluster, reserved sectors, FAT size, root/data LBAs, etc.
     fat_dir_entry ent;
-    list_root(&bpb, &ent, shell);
+    if (!fat_resolve("/", path, &ent) || (ent.attr & FAT_ATTR_DIR)) return -1;
+    // Walk the path down from the root to the file's directory entry.
+    // If found, 'ent' will contain its starting cluster and file size.
+    // The chain is turned into extents up front, so reads can be issued
+    // a whole contiguous run at a time without touching the FAT again.
+    uint32_t cluster_bytes = (uint32_t)f->fs->bpb.sectors_per_cluster * 512;
+    uint32_t need = (uint32_t)(((uint64_t)ent.size + cluster_bytes - 1) / cluster_bytes);
+    f->nextents = fat_chain_extents(f->fs, ent.first_cluster, need, NULL);
+    f->extents = NULL;
+    if (f->nextents) {
+        f->extents = thralloc(f->nextents * sizeof(fat_extent));
+        if (!f->extents) return -1;
+        fat_chain_extents(f->fs, ent.first_cluster, need, f->extents);
+    }
+    f->size = ent.size;
+    f->pos = 0;
+    f->ext = 0;
+    f->ext_index = 0;
+    f->next_pos = 0;
+    f->ra_end = 0;
+    f->ra_window = FAT_RA_MIN;
     return 0;
 }
 
+void fat_close(fat_file* f) {
+    if (f->extents) tfree(f->extents);
+    f->extents = NULL;
+    f->nextents = 0;
+}
 
-int list_dir_entry(const uint8_t* e, fat_dir_entry* out, ShellContext *shell) {
-    // Skip entries that are not valid files/directories:
-    // e[0]:q == 0x00 → no more entries in this directory (end marker)
-    // e[11] == 0x0F → long file name (LFN) entry, not a short 8.3 entry
-    // e[0] == 0xE5 → deleted entry
-    if (e[0] == 0x00 || e[11] == 0x0F || e[0] == 0xE5) {
-        //skippable entry
-        return 0;
+void fat_seek(fat_file* f, uint32_t pos) {
+    uint32_t cluster_bytes = (uint32_t)f->fs->bpb.sectors_per_cluster * 512;
+    uint32_t index = pos / cluster_bytes;
+    // Find the extent holding the new position
+    f->ext = 0;
+    f->ext_index = 0;
+    while (f->ext < f->nextents && f->ext_index + f->extents[f->ext].len <= index) {
+        f->ext_index += f->extents[f->ext].len;
+        f->ext++;
     }
-    // Extract the 8-character name field (offset 0x00–0x07)
-    // Replace space padding with '\0' to terminate the string early
-    for (int i = 0; i < 8; i++) {
-        out->name[i] = (e[i] == ' ') ? '\0' : e[i];
-        //sfprint("e[%d] = %c  i[%d] = %c\n", i, e[i], i, out->name[i]);
+    f->pos = pos;
+    // Whatever was prefetched ahead of the old position doesn't count here
+    f->ra_end = pos / 512;
+}
+
+// Prefetch from the first sector past the demand read through the
+// read-ahead window, counted from where another read of 'len' bytes would
+// end, one request per extent the range falls in; the next read then goes
+// out in the same command. While half a window is still ahead of the next
+// read nothing is queued, so small reads top it up in window-sized steps
+// rather than a sector or two at a time. Sectors are counted from the
+// start of the file.
+static void fat_readahead(fat_file* f, size_t len) {
+    const fat_fs* fs = f->fs;
+    uint32_t spc = fs->bpb.sectors_per_cluster;
+    // A partial last sector was read whole, so start after it
+    uint32_t sector = (f->pos + 511) / 512;
+    uint32_t next_end = (uint32_t)((f->pos + len) / 512);
+    uint32_t target = (next_end / spc + f->ra_window) * spc;
+    if (f->ra_end > sector) {
+        if (f->ra_end >= next_end + f->ra_window * spc / 2) return;
+        sector = f->ra_end;
     }
-    out->name[8] = '\0'; // Ensure null-termination
-    // Extract the 3-character extension field (offset 0x08–0x0A)
-    // Replace space padding with '\0'
-    for (int i = 0; i < 3; i++) {
-        out->ext[i] = (e[8 + i] == ' ') ? '\0' : e[8 + i];
+    uint32_t e = f->ext;
+    uint32_t e_sector = f->ext_index * spc;
+    while (sector < target && e < f->nextents) {
+        uint32_t e_end = e_sector + f->extents[e].len * spc;
+        if (sector < e_end) {
+            uint32_t end = (target < e_end) ? target : e_end;
+            uint32_t got = blk_prefetch(fat_cluster_lba(fs, f->extents[e].start) + (sector - e_sector), end - sector);
+            sector += got;
+            // Out of staging room: pick up from here next time
+            if (sector < end) break;
+        }
+        e_sector = e_end;
+        e++;
     }
-    out->ext[3] = '\0'; // Null-terminate
-    // File attributes byte (offset 0x0B)
-    // Bitfield: ReadOnly, Hidden, System, VolumeID, Directory, Archive
-    out->attr = e[11];
-    // First cluster number (offset 0x1A–0x1B)
-    // FAT12/16: this is the full cluster number
-    // FAT32: this is the low word; high word is at offset 0x14–0x15
-    out->first_cluster = e[26] | (e[27] << 8);
-    // File size in bytes (offset 0x1C–0x1F), little-endian
-    out->size = e[28] | (e[29] << 8) | (e[30] << 16) | (e[31] << 24);
-    // Return 1 to indicate a valid short directory entry was parsed
-    char full[13]; // 8 chars for name + 1 dot + 3 chars for ext + null terminator
-    int name_len = custom_strlen(out->name);
-    int ext_len = custom_strlen(out->ext);
-    for (int i = 0; i < name_len; i++) {
-        full[i] = out->name[i];
-    }
-    if (ext_len > 0) {
-        full[name_len] = '.';
-        for (int i = 0; i < 3; i++) {
-            full[i + (name_len +1)] = out->ext[i];
+    if (sector > f->ra_end) f->ra_end = sector;
+}
+
+int fat_read(fat_file* f, uint8_t* out, size_t len) {
+    uint32_t cluster_bytes = (uint32_t)f->fs->bpb.sectors_per_cluster * 512;
+    if (f->pos >= f->size) return 0;
+    if (len > f->size - f->pos) len = f->size - f->pos;
+    // Streaming means starting where the previous read ended
+    int streaming = (f->pos == f->next_pos);
+    size_t done = 0;
+    // Number of bytes copied into 'out' so far.
+    uint8_t head[512], tail[512];
+    // Bounce buffers for a partial first and last sector.
+    uint8_t* head_dst = NULL;
+    uint8_t* tail_dst = NULL;
+    size_t head_off = 0, head_len = 0, tail_len = 0;
+    BlkRequest reqs[FAT_READ_BATCH];
+    fat_read_batch batch = { 0, 0 };
+    int nreq = 0;
+    // Walk the extents from the cursor until the read is satisfied or the
+    // chain ends. Each extent is physically contiguous, so the part of it
+    // this read needs becomes one request. Data reads are only queued here;
+    // the block layer sorts and merges them when the batch is flushed.
+    while (done < len && f->ext < f->nextents) {
+        const fat_extent* e = &f->extents[f->ext];
+        // Byte offset of the cursor within the extent
+        size_t off = (size_t)(f->pos / cluster_bytes - f->ext_index) * cluster_bytes + f->pos % cluster_bytes;
+        size_t ext_bytes = (size_t)e->len * cluster_bytes;
+        size_t want = ext_bytes - off;
+        if (want > len - done) want = len - done;
+        size_t got = want;
+        // Absolute LBA of the sector holding the cursor
+        uint32_t lba = fat_cluster_lba(f->fs, e->start) + off / 512;
+        // A read that starts mid-sector takes that sector through a bounce
+        // buffer. Only the first run of a read can start unaligned.
+        if (off % 512) {
+            head_off = off % 512;
+            head_len = (want < 512 - head_off) ? want : 512 - head_off;
+            head_dst = out + done;
+            fat_queue(&reqs[nreq++], lba++, 1, head, &batch);
+            done += head_len;
+            want -= head_len;
+        }
+        // Whole sectors land straight in 'out'.
+        uint32_t full = want / 512;
+        if (full) {
+            fat_queue(&reqs[nreq++], lba, full, out + done, &batch);
+            lba += full;
+            done += (size_t)full * 512;
+            want -= (size_t)full * 512;
+        }
+        // The last sector may be partial; read it aside and copy what's needed
+        // once the batch has completed. This only happens on the final run.
+        if (want) {
+            tail_len = want;
+            tail_dst = out + done;
+            fat_queue(&reqs[nreq++], lba, 1, tail, &batch);
+            done += want;
+        }
+        // Advance the cursor, moving to the next extent if this one was used up
+        f->pos += got;
+        if (off + got == ext_bytes) {
+            f->ext_index += e->len;
+            f->ext++;
+        }
+        // Keep room for one more run plus its head and tail
+        if (nreq > FAT_READ_BATCH - 3) {
+            if (fat_flush(reqs, nreq, &batch) < 0) return -1;
+            nreq = 0;
         }
-        full[(name_len + 1) + 3] = '\0';
+    }
+    if (nreq && fat_flush(reqs, nreq, &batch) < 0) return -1;
+    f->next_pos = f->pos;
+    // Queue read-ahead past what was just read, without waiting for it, and
+    // widen the window for next time. Random access drops back to the minimum.
+    if (streaming) {
+        fat_readahead(f, len);
+        f->ra_window *= 2;
+        if (f->ra_window > FAT_RA_MAX) f->ra_window = FAT_RA_MAX;
     } else {
-        full[name_len] = '\0';
-    }
-    sfprint("%s\n", full);
-    int new_len = custom_strlen(full);
-    full[new_len] = '\0';
-    char full_with_nl[14]; // 13 chars for name + '\n' + '\0'
-    // Copy the filename into the new buffer
-    for (int j = 0; j < new_len; ++j) {
-        full_with_nl[j] = full[j];
-    }
-    full_with_nl[new_len]     = '\n';
-    full_with_nl[new_len + 1] = '\0';
-    fb_draw_stringsh(full_with_nl, new_len + 1, FG, BG, shell);
-    sfprint("new_len for %s = %d\n", full, new_len);
- 
-    return 1;
+        f->ra_window = FAT_RA_MIN;
+    }
+    if (head_dst) memcpy(head_dst, head + head_off, head_len);
+    if (tail_dst) memcpy(tail_dst, tail, tail_len);
+    // Return the number of bytes actually written to 'out'.
+    return (int)done;
 }
 
-int list_root(const fat_bpb* bpb, fat_dir_entry* out, ShellContext *shell) {
-    
-    uint32_t root_dir_sectors =
-        ((bpb->root_entry_count * 32) + (bpb->bytes_per_sector - 1)) / bpb->bytes_per_sector;
-    uint8_t sector[512]; // Temporary buffer for one sector of directory entries
-
-    // Loop through each sector of the root directory
-    for (uint32_t s = 0; s < root_dir_sectors; s++) {
-        //sfprint("loop %8\n", s);
-        // Read the current root directory sector from disk
-        ata_read_sector(bpb->root_start_lba + s, sector);
-        sfprint("Sector read: %8\n", bpb->root_start_lba + s);
+int fs_read_file(const char* path, uint8_t* out, size_t maxlen) {
+    fat_file f;
+    if (fat_open(path, &f) < 0) return -1;
+    int n = fat_read(&f, out, maxlen);
+    fat_close(&f);
+    return n;
+}
 
-        for (int i = 0; i < 512; i += 32) {
-            if (!list_dir_entry(sector + i, out, shell)) {
-                continue;
-            }  
-        } 
-    } 
-    // File not found in the root directory
-    sfprint("files printed\n");
-    return 0;
+int fs_list_files(ShellContext *shell, const char* path) {
+    sfprint("\n\nListing files\n");
+    return fat_list_dir(shell->cwd, path ? path : ".", shell);
 }
 
 
+// Chunk print_file streams through, from the heap to spare the kernel stack
+#define FAT_PRINT_CHUNK 4096
 
 int print_file(char *filename, ShellContext *shell) {
-    uint8_t buffer[4096];
-    int len = fs_read_file(filename, buffer, sizeof(buffer));
-    if (len > 0) {
-        buffer[len] = '\0';
-        clamp_n_scroll(shell);
-        fb_cursor.x = 0;
-        fb_cursor.y = shell->shell_line * FONT_HEIGHT;
-        fb_draw_stringsh(buffer, len, FG, BG, shell);
-        return 1;
-    } else {
+    char path[FAT_PATH_MAX];
+    fat_file f;
+    if (fat_path_join(shell->cwd, filename, path) < 0 || fat_open(path, &f) < 0) return 0;
+    uint8_t* buffer = thralloc(FAT_PRINT_CHUNK);
+    if (!buffer) {
+        fat_close(&f);
+        return 0;
+    }
+    // Stream the file a buffer at a time; sequential reads keep the
+    // read-ahead window growing so later chunks come from the cache.
+    int total = 0;
+    int len;
+    clamp_n_scroll(shell);
+    fb_cursor.x = 0;
+    fb_cursor.y = shell->shell_line * FONT_HEIGHT;
+    while ((len = fat_read(&f, buffer, FAT_PRINT_CHUNK)) > 0) {
+        fb_draw_stringsh((const char*)buffer, len, FG, BG, shell);
+        total += len;
+    }
+    tfree(buffer);
+    fat_close(&f);
+    if (total == 0) {
         sfprint("len == 0\n");
         return 0;
-        
     }
+    return 1;
 }
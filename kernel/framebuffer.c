@@ -9,6 +9,7 @@
 #include "string.h"
 #include "vga.h"
 #include "shell.h"
+#include "ramdisk.h"
 
 typedef struct ShellContext ShellContext;
 
@@ -380,9 +381,15 @@ void walk_mb2(void* mb_ptr) {
 
 
 
+        if (tag->type == 3 && tag->size >= sizeof(struct multiboot_tag_module)) {
+            // Copy the fixed fields out rather than alias the packed tag
+            struct multiboot_tag_module mod;
+            memcpy(&mod, tag, sizeof(mod));
+            ramdisk_add_module(&mod);
+        }
+
         if (tag->type == 6 && tag->size >= sizeof(struct multiboot_tag_mmap)) {
-            memb = (const struct multiboot_tag_mmap*)tag;
-            init_allocator(memb);   
+            memb = (const struct multiboot_tag_mmap*)tag; // loaded after the walk, once every tag is known
         }
 
 
@@ -471,4 +478,7 @@ void walk_mb2(void* mb_ptr) {
     
     }
     sfprint("finished MB walk\n");
+    if (memb) {
+        init_allocator(memb, mb_ptr);
+    }
 }
\ No newline at end of file
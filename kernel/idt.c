@@ -2,6 +2,7 @@
 #include "kbd.h"
 #include "shell.h"
 #include "assertf.h"
+#include "ata.h"
 #include <stdint.h>
 
 typedef unsigned long size_t;
@@ -94,7 +95,8 @@ int set_all_idt(void) {
     // make an array of handler names of the externs. t
     void (*handler_array[])() = {isr0,isr1,isr2,isr3,isr4,isr5,isr6,isr7,isr8,isr9,isr10,
     isr11,isr12,isr13,isr14,isr15,isr16,isr17,isr18,isr19,isr20,isr21,isr22,isr23,isr24,
-    isr25,isr26,isr27,isr28,isr29,isr30,isr31,isr32,isr33,isr34,isr35,isr36};
+    isr25,isr26,isr27,isr28,isr29,isr30,isr31,isr32,isr33,isr34,isr35,isr36,
+    isr37,isr38,isr39,isr40,isr41,isr42,isr43,isr44,isr45,isr46,isr47};
     
     // get the number of handlers
     int num_handlers = sizeof(handler_array) / sizeof(handler_array[0]);
@@ -137,6 +139,17 @@ int set_all_idt(void) {
     set_idt_entry(34, handler_array[34], 0x08, 0x8E);
     set_idt_entry(35, handler_array[35], 0x08, 0x8E);
     set_idt_entry(36, handler_array[36], 0x08, 0x8E);
+    set_idt_entry(37, handler_array[37], 0x08, 0x8E);
+    set_idt_entry(38, handler_array[38], 0x08, 0x8E);
+    set_idt_entry(39, handler_array[39], 0x08, 0x8E);
+    set_idt_entry(40, handler_array[40], 0x08, 0x8E);
+    set_idt_entry(41, handler_array[41], 0x08, 0x8E);
+    set_idt_entry(42, handler_array[42], 0x08, 0x8E);
+    set_idt_entry(43, handler_array[43], 0x08, 0x8E);
+    set_idt_entry(44, handler_array[44], 0x08, 0x8E);
+    set_idt_entry(45, handler_array[45], 0x08, 0x8E);
+    set_idt_entry(46, handler_array[46], 0x08, 0x8E);
+    set_idt_entry(47, handler_array[47], 0x08, 0x8E);
     
     return 0;
 }
@@ -164,6 +177,8 @@ void isr_handler(isr_frame_t* f) {
         }
         case 32: irq0_handler(f); break;
         case 33: irq1_handler(f); break;
+        case 46: ata_irq(0); break;
+        case 47: ata_irq(1); break;
         default: break;
     }
     uint32_t used = kbuff.head - kbuff.tail;
@@ -205,11 +220,43 @@ void remap_pic(void) {
     outb(0xA1, 0x01); // slave PIC: 8086 mode
 }
 
+static volatile uint64_t ticks = 0;
+
+// Channel 0, lobyte/hibyte, mode 2 (rate generator)
+void pit_init(uint32_t hz) {
+    uint32_t divisor = 1193182 / hz;
+    outb(0x43, 0x34);
+    outb(0x40, (uint8_t)(divisor & 0xFF));
+    outb(0x40, (uint8_t)(divisor >> 8));
+    irq_unmask(0);
+}
+
+uint64_t timer_ticks(void) {
+    return ticks;
+}
+
 void irq0_handler(isr_frame_t *f) {
+    ticks++;
     // Send EOI to PIC
     outb(0x20, 0x20);
 }
 
+// Slave lines (8-15) need an EOI on both chips
+void irq_eoi(uint8_t irq) {
+    if (irq >= 8) outb(0xA0, 0x20);
+    outb(0x20, 0x20);
+}
+
+void irq_unmask(uint8_t irq) {
+    uint16_t port = (irq < 8) ? 0x21 : 0xA1;
+    uint8_t mask = inb(port);
+    mask &= ~(1 << (irq & 7));
+    outb(port, mask);
+    if (irq >= 8) {
+        irq_unmask(2); // cascade
+    }
+}
+
 void irq1_handler(isr_frame_t *f) {
     uint8_t scancode = inb(0x60);
 
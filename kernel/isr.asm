@@ -47,8 +47,20 @@ isr_common_stub:
     ; Pass pointer to our frame to C in RDI
     mov rdi, rsp
 
+    ; Save SSE state: the kernel uses XMM regs (memcpy/memset wide paths and
+    ; whatever -O2 emits), so a handler must not clobber the interrupted code's.
+    ; FXSAVE needs a 16-byte aligned 512-byte area; RBX is callee-saved and
+    ; holds the pre-save RSP across the call.
+    mov rbx, rsp
+    sub rsp, 512
+    and rsp, -16
+    fxsave [rsp]
+
     call isr_handler
 
+    fxrstor [rsp]
+    mov rsp, rbx
+
     ; Restore all GPRs in reverse
     pop r15
     pop r14
@@ -110,3 +122,14 @@ ISR_NOERR 33
 ISR_NOERR 34
 ISR_NOERR 35
 ISR_NOERR 36
+ISR_NOERR 37
+ISR_NOERR 38
+ISR_NOERR 39
+ISR_NOERR 40
+ISR_NOERR 41
+ISR_NOERR 42
+ISR_NOERR 43
+ISR_NOERR 44
+ISR_NOERR 45
+ISR_NOERR 46
+ISR_NOERR 47
@@ -14,6 +14,9 @@
 #include "shell.h"
 #include "ata.h"
 #include "fat.h"
+#include "string.h"
+#include "pci.h"
+#include "blk.h"
 
 
 
@@ -36,6 +39,7 @@ void kernel_main(void* mb_info) {
 //initialize serial output
     serial_init();
     serial_write("Hello from kernel_main!\n");
+    string_init();
 
     // initialize GDT and IDT and MEM
     gdt_init();
@@ -43,6 +47,7 @@ void kernel_main(void* mb_info) {
     set_all_idt();
     __asm__ volatile ("lidt %0" : : "m"(idtr));
     remap_pic();
+    pit_init(TIMER_HZ);
     enable_irq();
     asm volatile("sti");
     log_gdt_state();
@@ -50,6 +55,15 @@ void kernel_main(void* mb_info) {
     
     // Walk multiboot header to pull necessary data and  
     walk_mb2(mb_info);
+    pci_enumerate();
+    ata_init();
+#if BLK_SELFTEST
+    blk_selftest();
+#endif
+    // The filesystem lives on the first ATA disk; with none, use a RAM disk
+    BlkDev *root = blkdev_find("hd0");
+    if (!root) root = blkdev_get(0);
+    if (root) blk_attach(root);
 
     fb_clear(0x00000000);
     fb_cursor_reset();
@@ -65,6 +79,7 @@ void kernel_main(void* mb_info) {
     //print_file("HELLO2.TXT", &shell);
     
     for (;;) {
+        if (blk_busy()) blk_idle();      // queued disk requests, timed writeback
         __asm__ __volatile__("sti; hlt"); // enable interrupts, sleep until IRQ
         read_sc(shell);                  // drain after wake
     }
@@ -1,71 +1,182 @@
 #include "mem.h"
 #include "serial.h"
 #include "multiboot.h"
+#include "string.h"
 #include <stddef.h>
 
 
 #define MAX_PAGES 1048576 // for 4 GiB of RAM
-#define HEAP_SIZE (300 * 1024)
-uint8_t page_bitmap[MAX_PAGES / 8]; // 128 KiB
+#define HEAP_SIZE (300 * 1024)     // static heap at _heap_start, usable before init_allocator
+#define HEAP_GROW_MIN (64 * 1024)  // smallest region pulled from the frame allocator
+#define SLAB_CACHE_MAX 2           // empty frame-backed slabs kept before giving frames back
+#define FRAME_WORDS (MAX_PAGES / 64)
+// Two-level frame map. page_bitmap has one bit per frame (1 = used); each bit of
+// frame_summary covers one page_bitmap word and is set while that word still has
+// a free frame, so full stretches of memory are skipped 4096 frames at a time.
+uint64_t page_bitmap[FRAME_WORDS];                 // 128 KiB
+static uint64_t frame_summary[FRAME_WORDS / 64];   // 2 KiB
+static uint64_t frame_hint;                        // next-fit: frame after the last allocation
+static int frames_ready;            // set once init_allocator has loaded the memory map
 
 
 extern uint8_t* _heap_start[];
+extern uint8_t* _kernel_start[];
+extern uint8_t* _kernel_end[];
+
+Chunk *free_head;         // explicit list of free chunks only
+static uint8_t *heap_end; // top of the static heap, slabs are carved downward from here
+static size_t chunk_bytes_in_use;
+static size_t heap_frames;         // frames currently lent to the heap (regions and slabs)
+static uint32_t slab_cached;       // frame-backed slabs sitting on slab_free_list
+
+static uint64_t grab_frames(size_t count, size_t align);
+
+#define SLAB_HDR_SIZE ((sizeof(Slab) + 15) & ~15)
+// One bit per SLAB_SIZE block of the 4 GiB identity map: set when the block is a slab
+static uint8_t slab_map[MAX_PAGES / SLAB_PAGES / 8];
+static Slab *slab_partial[SLAB_CLASSES]; // slabs with at least one free object
+static Slab *slab_free_list;             // empty slabs kept for reuse by any class
+static size_t slab_bytes_in_use;
+
+
+/////////////////////////////////////////////////////////////////
+// BOUNDARY TAGGED CHUNKS //////////////////////////////////////
+///////////////////////////////////////////////////////////////
+
+static inline size_t chunk_size(const Chunk *c) {
+    return c->size & ~CHUNK_USED;
+}
+
+static inline int chunk_is_free(const Chunk *c) {
+    return !(c->size & CHUNK_USED);
+}
+
+static inline Chunk* chunk_next(Chunk *c) { // physical neighbour above
+    return (Chunk*)((uint8_t*)c + CHUNK_HDR_SIZE + chunk_size(c));
+}
+
+static inline Chunk* chunk_prev(Chunk *c) { // physical neighbour below
+    return (Chunk*)((uint8_t*)c - c->prev_size - CHUNK_HDR_SIZE);
+}
+
+static inline void free_list_insert(Chunk *c) {
+    c->prev_free = NULL;
+    c->next_free = free_head;
+    if (free_head) free_head->prev_free = c;
+    free_head = c;
+}
+
+static inline void free_list_remove(Chunk *c) {
+    if (c->prev_free) {
+        c->prev_free->next_free = c->next_free;
+    } else {
+        free_head = c->next_free;
+    }
+    if (c->next_free) c->next_free->prev_free = c->prev_free;
+}
+
+// Lay out [fence][free block][fence] over a region. The zero-sized used fences
+// stop coalescing from running off either end.
+static Chunk* chunk_region_init(uint8_t *start, size_t length) {
+    Chunk *lo = (Chunk*)start;
+    Chunk *hi = (Chunk*)(start + length - CHUNK_HDR_SIZE);
+    Chunk *c  = (Chunk*)(start + CHUNK_HDR_SIZE);
+
+    lo->prev_size = 0;
+    lo->size = 0 | CHUNK_USED;
+    c->prev_size = 0;
+    c->size = (uint8_t*)hi - (uint8_t*)c - CHUNK_HDR_SIZE;
+    hi->prev_size = c->size;
+    hi->size = 0 | CHUNK_USED;
+    free_list_insert(c);
+    return c;
+}
+
+
+static inline int in_static_heap(const void *ptr) {
+    return (const uint8_t*)ptr >= (const uint8_t*)_heap_start &&
+           (const uint8_t*)ptr < (const uint8_t*)_heap_start + HEAP_SIZE;
+}
+
+// Pull a fresh region of contiguous frames big enough for 'size' payload bytes
+static int heap_grow(size_t size) {
+    size_t bytes = size + 3 * CHUNK_HDR_SIZE; // two fences plus the block header
+    if (bytes < HEAP_GROW_MIN) bytes = HEAP_GROW_MIN;
+    size_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    uint64_t base = grab_frames(pages, 1);
+    if (!base) return 0;
+    heap_frames += pages;
+    chunk_region_init((uint8_t*)(uintptr_t)base, pages * PAGE_SIZE);
+    LOG(LOG_LEVEL_DEBUG, "heap_grow: %8 pages at %8", (uint64_t)pages, base);
+    return 1;
+}
+
+// A free block whose neighbours are both fences spans its whole region.
+// Regions that came from the frame allocator go back to it.
+static int heap_try_release(Chunk *c) {
+    Chunk *lo = chunk_prev(c);
+    Chunk *hi = chunk_next(c);
+    if (chunk_size(lo) != 0 || chunk_size(hi) != 0) return 0;
+    if (in_static_heap(lo)) return 0;
+
+    size_t pages = ((uint8_t*)hi + CHUNK_HDR_SIZE - (uint8_t*)lo) / PAGE_SIZE;
+    free_list_remove(c);
+    free_frames((uintptr_t)lo, pages);
+    heap_frames -= pages;
+    LOG(LOG_LEVEL_DEBUG, "heap_release: %8 pages at %8", (uint64_t)pages, (uint64_t)(uintptr_t)lo);
+    return 1;
+}
 
-Chunk *free_head;
 
 void mem_init(){
-    sfprint("mem_init: Entered mem_init\n");
-    sfprint("mem_init: Heap start: 0x%x\n", (uint32_t)(uintptr_t)_heap_start);
-    free_head = (Chunk*)_heap_start;
-    sfprint("mem_init: free head chunked\n");
-    free_head->size = HEAP_SIZE - sizeof(Chunk);
-    sfprint("mem_init: free_head size: %8\n", free_head->size);
-    free_head->is_free = 1;
-    free_head->next = ((void *)0);
-    sfprint("mem_init: free_head is_free: %8\n", free_head->is_free);
-    sfprint("mem_init: free_head next: %8\n", free_head->next);
+    LOG(LOG_LEVEL_INFO, "mem_init: Heap start: 0x%x", (uint32_t)(uintptr_t)_heap_start);
+    free_head = NULL;
+    heap_end = (uint8_t*)_heap_start + HEAP_SIZE;
+    Chunk *first = chunk_region_init((uint8_t*)_heap_start, HEAP_SIZE);
+    LOG(LOG_LEVEL_INFO, "mem_init: free_head size: %8", (uint64_t)chunk_size(first));
 }
 
 
-void* thralloc(size_t size) { // Alloc a block of mem from the heap of at least 'size' bytes
+static void* chunk_alloc(size_t size) { // Alloc a block of mem from the free list of at least 'size' bytes
     size = (size + 15) & ~15;
-    sfprint("Allocating %8 bytes\n", size); 
-    Chunk *current = free_head; //scan from the first free chunk 
-    Chunk *prev = ((void *)0); // Keep track of the previous chunk (currently unused here, initialized to NULL)
-    // Loop through linked list of chunks until out
-    while (current) { 
-        if ((current->is_free) && (current->size >= size)) { // if chunk is free and chunky enough
-            if (current->size >= size + sizeof(Chunk)) { // if the chunk is too chunky, split
-                Chunk *new_chunk = (Chunk *)((uint8_t *)(current + 1) + size); // Calculate address of new chunk header after alloc'd space
-                new_chunk->size = current->size - size - sizeof(Chunk); // Set new chunk's size to leftover space after alloc
-                new_chunk->is_free = 1; // Mark as free
-                new_chunk->next = current->next; // Link new chunk into list after current chunk
-                current->size = size; // Shrink current chunk to the requested size
-                current->next = new_chunk; // Link current chunk to new chunk
-                if (new_chunk && (uintptr_t)new_chunk <= (uintptr_t)(current + 1)) {
-                    sfprint("Chunk overlap detected!\n");
-                }
-            }
-            current->is_free = 0; // Mark the current chunk as used
-            return (void*)(current + 1); // Return a pointer to the memory just after the chunk header (usable space)
+    if (size < CHUNK_MIN_SIZE) size = CHUNK_MIN_SIZE;
+    LOG(LOG_LEVEL_TRACE, "Allocating %8 bytes", (uint64_t)size);
+    int grown = 0;
+retry:
+    // Only free chunks are on the list, first fit
+    for (Chunk *current = free_head; current; current = current->next_free) {
+        size_t have = chunk_size(current);
+        if (have < size) continue;
+
+        free_list_remove(current);
+        if (have >= size + CHUNK_HDR_SIZE + CHUNK_MIN_SIZE) { // if the chunk is too chunky, split
+            Chunk *rest = (Chunk*)((uint8_t*)current + CHUNK_HDR_SIZE + size);
+            rest->prev_size = size;
+            rest->size = have - size - CHUNK_HDR_SIZE;
+            chunk_next(rest)->prev_size = rest->size;
+            free_list_insert(rest);
+            have = size;
         }
-        current = current->next; // Move to the next chunk in the list
+        current->size = have | CHUNK_USED;
+        chunk_bytes_in_use += have + CHUNK_HDR_SIZE;
+        return (uint8_t*)current + CHUNK_HDR_SIZE;
     }
-    thralloc_total();
+    if (!grown && heap_grow(size)) { // out of room, pull more frames and go again
+        grown = 1;
+        goto retry;
+    }
+    LOG(LOG_LEVEL_WARN, "thralloc: no room for %8 bytes", (uint64_t)size);
     return NULL; // No suitable chunk found, return NULL
 }
 
 void* cralloc(size_t num, size_t size) {
     //size = (size + 15) & ~15;
     size_t total = num * size;
-    void* ptr = thralloc(total);
+    void* ptr = thralloc_at(total, __builtin_return_address(0));
     if (!ptr) return NULL;
 
-    uint8_t* byte_ptr = (uint8_t*)ptr;
-    for (size_t i = 0; i < total; i++) {
-        byte_ptr[i] = 0;
-    }
-    thralloc_total();
+    memset(ptr, 0, total);
     return ptr;
 }
 
@@ -73,107 +184,720 @@ void* cralloc(size_t num, size_t size) {
 
 
 size_t thralloc_total() {
-    size_t total = 0;
-    Chunk* current = free_head; // scan from first free chunk
+    size_t total = chunk_bytes_in_use + slab_bytes_in_use;
+    LOG(LOG_LEVEL_INFO, "Total memory allocated: %8 (%8 heap frames)", (uint64_t)total, (uint64_t)heap_frames);
+    return total;
+}
+
+
+static void chunk_free(void *ptr) { // Free a block and merge it with free neighbours in O(1)
+    Chunk *chunk = (Chunk*)((uint8_t*)ptr - CHUNK_HDR_SIZE);
+    size_t size = chunk_size(chunk);
+    LOG(LOG_LEVEL_TRACE, "Freeing %8 bytes", (uint64_t)size);
+    chunk_bytes_in_use -= size + CHUNK_HDR_SIZE;
+
+    // Coalesce with next chunk if it's free
+    Chunk *next = chunk_next(chunk);
+    if (chunk_is_free(next)) {
+        free_list_remove(next);
+        size += CHUNK_HDR_SIZE + chunk_size(next);
+    }
+    // Coalesce with previous chunk if it's free; it is already on the list
+    Chunk *prev = chunk_prev(chunk);
+    if (chunk_is_free(prev)) {
+        size += CHUNK_HDR_SIZE + chunk_size(prev);
+        chunk = prev;
+    } else {
+        free_list_insert(chunk);
+    }
+    chunk->size = size;
+    chunk_next(chunk)->prev_size = size;
+    heap_try_release(chunk);
+}
+
+
+
 
-    while (current) {
-        if (!current->is_free) { // while chunk is used
-            total += current->size + sizeof(Chunk); // add size of used chunk to total
+/////////////////////////////////////////////////////////////////
+// SLAB SIZE CLASSES ///////////////////////////////////////////
+///////////////////////////////////////////////////////////////
+
+static inline int slab_is_slab(const void *ptr) {
+    uint64_t idx = (uintptr_t)ptr / SLAB_SIZE;
+    if (idx >= sizeof(slab_map) * 8) return 0;
+    return (slab_map[idx / 8] >> (idx % 8)) & 1;
+}
+
+static inline void slab_map_set(Slab *slab, int on) {
+    uint64_t idx = (uintptr_t)slab / SLAB_SIZE;
+    if (on) {
+        slab_map[idx / 8] |= (1 << (idx % 8));
+    } else {
+        slab_map[idx / 8] &= ~(1 << (idx % 8));
+    }
+}
+
+// Round a request up to its power-of-two class: 1..16 -> 0, 17..32 -> 1, ... 2048 -> 7
+static inline uint32_t slab_class(size_t size) {
+    if (size <= (1 << SLAB_MIN_SHIFT)) return 0;
+    uint32_t shift = 64 - __builtin_clzl(size - 1);
+    return shift - SLAB_MIN_SHIFT;
+}
+
+// Take a SLAB_SIZE aligned block off the top of the heap by shrinking the
+// last chunk. Only happens when a class runs dry and no empty slab is cached.
+static Slab* slab_carve(void) {
+    Chunk *fence = (Chunk*)(heap_end - CHUNK_HDR_SIZE);
+    Chunk *last = chunk_prev(fence);
+    if (!chunk_is_free(last)) return NULL;
+
+    uint8_t *block = (uint8_t*)(((uintptr_t)heap_end - SLAB_SIZE) & ~(uintptr_t)(SLAB_SIZE - 1));
+    Chunk *new_fence = (Chunk*)(block - CHUNK_HDR_SIZE);
+    uint8_t *payload = (uint8_t*)last + CHUNK_HDR_SIZE;
+    if ((uint8_t*)new_fence < payload + CHUNK_MIN_SIZE) return NULL; // leave the last chunk usable
+
+    last->size = (uint8_t*)new_fence - payload;
+    new_fence->prev_size = last->size;
+    new_fence->size = 0 | CHUNK_USED;
+    heap_end = block;
+    return (Slab*)block;
+}
+
+// Frame-backed slabs are preferred so the static heap stays free for chunks;
+// before init_allocator has run, slabs come off the static heap instead.
+static Slab* slab_grab(void) {
+    uint64_t base = grab_frames(SLAB_PAGES, SLAB_PAGES);
+    if (base) {
+        heap_frames += SLAB_PAGES;
+        return (Slab*)(uintptr_t)base;
+    }
+    return slab_carve();
+}
+
+static Slab* slab_new(uint32_t cls) {
+    Slab *slab = slab_free_list;
+    if (slab) {
+        slab_free_list = slab->next;
+        if (!in_static_heap(slab)) slab_cached--;
+    } else {
+        slab = slab_grab();
+        if (!slab) return NULL;
+        slab_map_set(slab, 1);
+    }
+    size_t obj_size = (size_t)1 << (cls + SLAB_MIN_SHIFT);
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->free = NULL;
+    slab->bump = (uint8_t*)slab + SLAB_HDR_SIZE;
+    slab->in_use = 0;
+    slab->capacity = (SLAB_SIZE - SLAB_HDR_SIZE) / obj_size;
+    slab->cls = cls;
+    return slab;
+}
+
+static inline void slab_unlink(Slab *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        slab_partial[slab->cls] = slab->next;
+    }
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->next = slab->prev = NULL;
+}
+
+static inline void slab_push(Slab *slab) {
+    slab->prev = NULL;
+    slab->next = slab_partial[slab->cls];
+    if (slab->next) slab->next->prev = slab;
+    slab_partial[slab->cls] = slab;
+}
+
+static void* slab_alloc(size_t size) {
+    uint32_t cls = slab_class(size);
+    Slab *slab = slab_partial[cls];
+    if (!slab) {
+        slab = slab_new(cls);
+        if (!slab) return NULL;
+        slab_push(slab);
+    }
+
+    size_t obj_size = (size_t)1 << (cls + SLAB_MIN_SHIFT);
+    void *obj;
+    if (slab->free) {
+        obj = slab->free;
+        slab->free = slab->free->next;
+    } else {
+        obj = slab->bump;
+        slab->bump += obj_size;
+    }
+    if (++slab->in_use == slab->capacity) {
+        slab_unlink(slab); // full slabs leave the partial list until something is freed
+    }
+    slab_bytes_in_use += obj_size;
+    return obj;
+}
+
+static void slab_release(void *ptr) {
+    Slab *slab = (Slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+    SlabObj *obj = (SlabObj*)ptr;
+
+    if (slab->in_use == slab->capacity) {
+        slab_push(slab); // was full, has room again
+    }
+    obj->next = slab->free;
+    slab->free = obj;
+    slab_bytes_in_use -= (size_t)1 << (slab->cls + SLAB_MIN_SHIFT);
+
+    if (--slab->in_use == 0) {
+        slab_unlink(slab);
+        if (!in_static_heap(slab) && slab_cached >= SLAB_CACHE_MAX) {
+            slab_map_set(slab, 0);
+            free_frames((uintptr_t)slab, SLAB_PAGES);
+            heap_frames -= SLAB_PAGES;
+            return;
         }
-        current = current->next; // walk to the next chunk
+        if (!in_static_heap(slab)) slab_cached++;
+        slab->next = slab_free_list;
+        slab_free_list = slab;
     }
-    sfprint("Total memory allocated: %8\n", total);
-    return total;
 }
 
 
+static void* raw_alloc(size_t size) {
+    if (size <= SLAB_MAX_OBJ) {
+        void *ptr = slab_alloc(size);
+        if (ptr) return ptr;
+        // no slab could be carved, fall through to the chunk list
+    }
+    return chunk_alloc(size);
+}
+
+static void raw_free(void *ptr) {
+    if (slab_is_slab(ptr)) {
+        slab_release(ptr);
+        return;
+    }
+    chunk_free(ptr);
+}
+
+#if MEM_PROFILE
+// Bytes actually backing an allocation: its size class or its chunk payload
+static size_t raw_usable(void *ptr) {
+    if (slab_is_slab(ptr)) {
+        Slab *slab = (Slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+        return (size_t)1 << (slab->cls + SLAB_MIN_SHIFT);
+    }
+    return chunk_size((Chunk*)((uint8_t*)ptr - CHUNK_HDR_SIZE));
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////
+// ALLOCATION SITE PROFILER ////////////////////////////////////
+///////////////////////////////////////////////////////////////
+
+#if MEM_PROFILE
+// Open-addressed on the call site. Once full, new sites are all counted
+// in one overflow entry kept outside the table.
+static AllocSite prof_sites[MEM_PROFILE_SITES];
+static AllocSite prof_overflow;
+
+static AllocSite* prof_lookup(void *site) {
+    uint32_t h = (uint32_t)(((uintptr_t)site * 0x9E3779B97F4A7C15ULL) >> 57) % MEM_PROFILE_SITES;
+    for (int i = 0; i < MEM_PROFILE_SITES; i++) {
+        AllocSite *e = &prof_sites[(h + i) % MEM_PROFILE_SITES];
+        if (e->site == site || (!e->site && !e->allocs)) {
+            e->site = site;
+            return e;
+        }
+    }
+    return &prof_overflow;
+}
+
+static void prof_alloc(AllocTag *tag, size_t usable) {
+    AllocSite *e = prof_lookup(tag->site);
+    e->allocs++;
+    e->live_bytes += tag->size;
+    e->slack_bytes += usable - sizeof(AllocTag) - tag->size;
+    if (e->live_bytes > e->peak_bytes) e->peak_bytes = e->live_bytes;
+}
+
+static void prof_free(AllocTag *tag, size_t usable) {
+    AllocSite *e = prof_lookup(tag->site);
+    e->frees++;
+    e->live_bytes -= tag->size;
+    e->slack_bytes -= usable - sizeof(AllocTag) - tag->size;
+}
+#endif
+
+// Fill 'out' with up to 'max' sites ordered by live bytes, largest first
+int mem_top_sites(AllocSite *out, int max) {
+    int n = 0;
+#if MEM_PROFILE
+    for (int i = 0; i <= MEM_PROFILE_SITES; i++) {
+        AllocSite *e = (i < MEM_PROFILE_SITES) ? &prof_sites[i] : &prof_overflow;
+        if (!e->allocs) continue;
+        int at = n;
+        while (at > 0 && out[at - 1].live_bytes < e->live_bytes) {
+            if (at < max) out[at] = out[at - 1];
+            at--;
+        }
+        if (at < max) out[at] = *e;
+        if (n < max) n++;
+    }
+#else
+    (void)out;
+    (void)max;
+#endif
+    return n;
+}
+
+
+void* thralloc_at(size_t size, void *site) {
+#if MEM_PROFILE
+    AllocTag *tag = raw_alloc(size + sizeof(AllocTag));
+    if (!tag) return NULL;
+    tag->site = site;
+    tag->size = size;
+    prof_alloc(tag, raw_usable(tag));
+    return tag + 1;
+#else
+    (void)site;
+    return raw_alloc(size);
+#endif
+}
+
+void* thralloc(size_t size) { // Alloc a block of mem from the heap of at least 'size' bytes
+    return thralloc_at(size, __builtin_return_address(0));
+}
+
 void tfree(void *ptr) { // Free a previously allocated block
     if (ptr == NULL) return; // Ignore NULL frees
-    Chunk *chunk = ((Chunk*)ptr) - 1; // Step back from the payload to get the chunk header
-    sfprint("Freeing %8 bytes\n", chunk->size);
-    chunk->is_free = 1; // Mark this chunk as free
-    sfprint("Freed %8 bytes, checking Coalesce opp\n", chunk->size);
-    // Coalesce with next chunk if it's free
-    if (chunk->next && chunk->next->is_free) {
-        chunk->size += sizeof(Chunk) + chunk->next->size; // Absorb next chunk's space
-        chunk->next = chunk->next->next; // Skip over the absorbed chunk
-        //sfprint("Combining chunks\n");
+#if MEM_PROFILE
+    AllocTag *tag = (AllocTag*)ptr - 1;
+    prof_free(tag, raw_usable(tag));
+    raw_free(tag);
+#else
+    raw_free(ptr);
+#endif
+}
+
+void mem_heap_stats(HeapStats *out) {
+    out->chunk_bytes = chunk_bytes_in_use;
+    out->slab_bytes = slab_bytes_in_use;
+    out->heap_frames = heap_frames;
+    out->free_bytes = 0;
+    out->free_chunks = 0;
+    out->largest_free = 0;
+    for (Chunk *c = free_head; c; c = c->next_free) {
+        size_t size = chunk_size(c);
+        out->free_bytes += size;
+        if (size > out->largest_free) out->largest_free = size;
+        out->free_chunks++;
     }
-    //sfprint("Checking previous chunk\n");
-    // Coalesce with previous chunk if it's free
-    Chunk *current = free_head;
-    Chunk *prev = NULL;
-    //sfprint("Walking list to find chunk\n");
-    while (current && current != chunk) { // Walk list to find the chunk
-        prev = current;
-        current = current->next;
+}
+
+
+
+
+/////////////////////////////////////////////////////////////////
+// ARENAS //////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////
+
+void arena_init(Arena *arena) {
+    arena->head = NULL;
+}
+
+static ArenaBlock* arena_grow(Arena *arena, size_t size) {
+    size_t data = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+    ArenaBlock *block = thralloc(sizeof(ArenaBlock) + data);
+    if (!block) return NULL;
+    block->size = data;
+    block->used = 0;
+    block->next = arena->head;
+    arena->head = block;
+    return block;
+}
+
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + 15) & ~15;
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        block = arena_grow(arena, size);
+        if (!block) return NULL;
     }
-    if (prev && prev->is_free) {
-        prev->size += sizeof(Chunk) + chunk->size; // Merge into previous
-        prev->next = chunk->next; // Skip over current chunk
+    void *ptr = (uint8_t*)(block + 1) + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void* arena_calloc(Arena *arena, size_t num, size_t size) {
+    size_t total = num * size;
+    uint8_t *ptr = arena_alloc(arena, total);
+    if (!ptr) return NULL;
+    memset(ptr, 0, total);
+    return ptr;
+}
+
+char* arena_strdup(Arena *arena, const char *str) {
+    size_t len = 0;
+    while (str[len]) len++;
+    char *dup = arena_alloc(arena, len + 1);
+    if (!dup) return NULL;
+    memcpy(dup, str, len + 1);
+    return dup;
+}
+
+// Drop everything at once. The oldest block is kept so a steady stream of
+// command lines never touches the heap again.
+void arena_reset(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    if (!block) return;
+    while (block->next) {
+        ArenaBlock *next = block->next;
+        tfree(block);
+        block = next;
     }
-    thralloc_total();
+    block->used = 0;
+    arena->head = block;
+}
+
+void arena_destroy(Arena *arena) {
+    arena_reset(arena);
+    tfree(arena->head);
+    arena->head = NULL;
 }
 
 
+/////////////////////////////////////////////////////////////////
+// PHYSICAL FRAMES /////////////////////////////////////////////
+///////////////////////////////////////////////////////////////
+
+static inline void summary_update(uint64_t w) {
+    if (~page_bitmap[w]) {
+        frame_summary[w / 64] |= (1ULL << (w % 64));
+    } else {
+        frame_summary[w / 64] &= ~(1ULL << (w % 64));
+    }
+}
 
+// Set or clear 'count' frame bits starting at 'first', a word at a time
+static void frame_mark(uint64_t first, uint64_t count, int used) {
+    uint64_t end = first + count;
+    if (end > MAX_PAGES) end = MAX_PAGES;
+
+    while (first < end) {
+        uint64_t w = first / 64;
+        uint64_t bit = first % 64;
+        uint64_t n = 64 - bit;
+        if (n > end - first) n = end - first;
+        uint64_t mask = (n == 64) ? ~0ULL : (((1ULL << n) - 1) << bit);
+
+        if (used) {
+            page_bitmap[w] |= mask;
+        } else {
+            page_bitmap[w] &= ~mask;
+        }
+        summary_update(w);
+        first += n;
+    }
+}
+
+// First free frame at or after 'pos', or MAX_PAGES if there is none
+static uint64_t frame_find_free(uint64_t pos) {
+    while (pos < MAX_PAGES) {
+        uint64_t w = pos / 64;
+        uint64_t free = ~page_bitmap[w] & (~0ULL << (pos % 64));
+        if (free) return w * 64 + __builtin_ctzll(free);
+
+        // Nothing left in this word, jump straight to the next word the summary says has room
+        w++;
+        uint64_t s = w / 64;
+        if (s >= FRAME_WORDS / 64) break;
+        uint64_t bits = frame_summary[s] & (~0ULL << (w % 64));
+        while (!bits) {
+            if (++s >= FRAME_WORDS / 64) return MAX_PAGES;
+            bits = frame_summary[s];
+        }
+        pos = (s * 64 + __builtin_ctzll(bits)) * 64;
+    }
+    return MAX_PAGES;
+}
+
+// First used frame in [pos, limit), or 'limit' if the whole span is free
+static uint64_t frame_find_used(uint64_t pos, uint64_t limit) {
+    while (pos < limit) {
+        uint64_t w = pos / 64;
+        uint64_t used = page_bitmap[w] & (~0ULL << (pos % 64));
+        if (used) {
+            uint64_t at = w * 64 + __builtin_ctzll(used);
+            return (at < limit) ? at : limit;
+        }
+        pos = (w + 1) * 64;
+    }
+    return limit;
+}
+
+// Look for 'count' free frames starting on an 'align' boundary in [from, to)
+static uint64_t frame_find_run(uint64_t from, uint64_t to, uint64_t count, uint64_t align) {
+    if (to > MAX_PAGES) to = MAX_PAGES;
+    uint64_t pos = from;
+    while (pos < to) {
+        uint64_t start = frame_find_free(pos);
+        start = (start + align - 1) & ~(align - 1);
+        if (start + count > to) break;
+
+        uint64_t used = frame_find_used(start, start + count);
+        if (used == start + count) return start;
+        pos = used + 1;
+    }
+    return MAX_PAGES;
+}
 
 void add_region(uint64_t base, uint64_t length) {
-    uint64_t start_page = base / 4096;
+    uint64_t start_page = (base + 4095) / 4096;
     uint64_t end_page = (base + length) / 4096;
 
-    for (uint64_t i = start_page; i < end_page; i++) {
-        page_bitmap[i / 8] &= ~(1 << (i % 8)); // mark as free
+    if (end_page > start_page) {
+        frame_mark(start_page, end_page - start_page, 0); // mark as free
+    }
+}
+
+void reserve_region(uint64_t base, uint64_t length) {
+    uint64_t start_page = base / 4096;
+    uint64_t end_page = (base + length + 4095) / 4096;
+
+    if (end_page > start_page) {
+        frame_mark(start_page, end_page - start_page, 1); // mark as used
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+// BUDDY ALLOCATOR /////////////////////////////////////////////
+///////////////////////////////////////////////////////////////
+// page_bitmap stays the per-frame truth; every free frame also belongs to
+// exactly one free buddy block, listed by order. A free block keeps its list
+// node in its own first bytes, so a buddy is mergeable when its first frame is
+// free and the node there records the same order.
+
+static FrameBlock *buddy_free_list[BUDDY_MAX_ORDER + 1];
+
+static inline int frame_is_free(uint64_t frame) {
+    return !((page_bitmap[frame / 64] >> (frame % 64)) & 1);
+}
+
+static inline void buddy_push(uint64_t frame, uint32_t order) {
+    FrameBlock *b = (FrameBlock*)(uintptr_t)(frame * PAGE_SIZE);
+    b->order = order;
+    b->prev = NULL;
+    b->next = buddy_free_list[order];
+    if (b->next) b->next->prev = b;
+    buddy_free_list[order] = b;
+}
+
+static inline void buddy_unlink(FrameBlock *b) {
+    if (b->prev) {
+        b->prev->next = b->next;
+    } else {
+        buddy_free_list[b->order] = b->next;
+    }
+    if (b->next) b->next->prev = b->prev;
+}
+
+// Largest order a block starting at 'frame' may have while fitting in 'count'
+static inline uint32_t buddy_fit_order(uint64_t frame, uint64_t count) {
+    uint32_t order = BUDDY_MAX_ORDER;
+    while ((frame & ((1ULL << order) - 1)) || (1ULL << order) > count) {
+        order--;
+    }
+    return order;
+}
+
+uint64_t buddy_alloc(uint32_t order) {
+    if (order > BUDDY_MAX_ORDER) return 0;
+
+    uint32_t k = order;
+    while (k <= BUDDY_MAX_ORDER && !buddy_free_list[k]) k++;
+    if (k > BUDDY_MAX_ORDER) return 0; // out of memory
+
+    FrameBlock *b = buddy_free_list[k];
+    buddy_unlink(b);
+    uint64_t frame = (uintptr_t)b / PAGE_SIZE;
+    while (k > order) { // hand the upper halves back as we split down
+        k--;
+        buddy_push(frame + (1ULL << k), k);
+    }
+    frame_mark(frame, 1ULL << order, 1);
+    return frame * PAGE_SIZE;
+}
+
+void buddy_free(uint64_t addr, uint32_t order) {
+    uint64_t frame = addr / PAGE_SIZE;
+    frame_mark(frame, 1ULL << order, 0);
+
+    while (order < BUDDY_MAX_ORDER) {
+        uint64_t buddy = frame ^ (1ULL << order);
+        if (buddy >= MAX_PAGES || !frame_is_free(buddy)) break;
+        FrameBlock *b = (FrameBlock*)(uintptr_t)(buddy * PAGE_SIZE);
+        if (b->order != order) break; // buddy is split, part of it is in use
+        buddy_unlink(b);
+        frame &= ~(1ULL << order);
+        order++;
+    }
+    buddy_push(frame, order);
+}
+
+uint64_t alloc_huge_frame() {
+    return buddy_alloc(BUDDY_MAX_ORDER);
+}
+
+void free_huge_frame(uint64_t addr) {
+    buddy_free(addr, BUDDY_MAX_ORDER);
+}
+
+// Split an arbitrary run of frames into aligned blocks and free each one
+void free_frames(uint64_t addr, size_t count) {
+    uint64_t frame = addr / PAGE_SIZE;
+    while (count) {
+        uint32_t order = buddy_fit_order(frame, count);
+        buddy_free(frame * PAGE_SIZE, order);
+        frame += 1ULL << order;
+        count -= 1ULL << order;
+    }
+}
+
+// Runs longer than the largest block are built from whole 2 MiB blocks: a fully
+// free aligned 2 MiB span is always a single top-order block, so the word
+// scans find it and each block is pulled off its list directly.
+static uint64_t alloc_frames_huge_run(size_t count, size_t align) {
+    uint64_t span = 1ULL << BUDDY_MAX_ORDER;
+    uint64_t blocks = (count + span - 1) / span;
+    if (align < span) align = span;
+
+    uint64_t start = frame_find_run(frame_hint, MAX_PAGES, blocks * span, align);
+    if (start == MAX_PAGES) {
+        start = frame_find_run(0, frame_hint + blocks * span, blocks * span, align);
+        if (start == MAX_PAGES) return 0; // out of memory
+    }
+    for (uint64_t i = 0; i < blocks; i++) {
+        buddy_unlink((FrameBlock*)(uintptr_t)((start + i * span) * PAGE_SIZE));
+    }
+    frame_mark(start, blocks * span, 1);
+    frame_hint = start + blocks * span;
+    if (blocks * span > count) {
+        free_frames((start + count) * PAGE_SIZE, blocks * span - count);
     }
+    return start * PAGE_SIZE;
+}
+
+// 'align' is in frames and must be a power of two. Returns 0 when no such
+// run exists. The unused tail of the rounded-up block goes straight back.
+uint64_t alloc_frames_aligned(size_t count, size_t align) {
+    if (count == 0) return 0;
+    if (align == 0) align = 1;
+
+    size_t need = (count > align) ? count : align;
+    uint32_t order = 0;
+    while ((1ULL << order) < need) order++;
+    if (order > BUDDY_MAX_ORDER) {
+        return alloc_frames_huge_run(count, align);
+    }
+
+    uint64_t addr = buddy_alloc(order);
+    if (addr && (1ULL << order) > count) {
+        free_frames(addr + count * PAGE_SIZE, (1ULL << order) - count);
+    }
+    return addr;
+}
+
+uint64_t alloc_frames(size_t count) {
+    return alloc_frames_aligned(count, 1);
 }
 
 uint64_t alloc_frame() {
-    for (uint64_t i = 0; i < MAX_PAGES; i++) {
-        if ((page_bitmap[i / 8] & (1 << (i % 8))) == 0) {
-            page_bitmap[i / 8] |= (1 << (i % 8)); // mark as used
-            return i * 4096;
+    return buddy_alloc(0);
+}
+
+void free_frame(uint64_t addr) {
+    buddy_free(addr, 0);
+}
+
+// Hand every free run in page_bitmap to the buddy lists. Greedy maximal
+// aligned blocks never leave two free buddies of the same order side by side.
+static void buddy_seed(void) {
+    uint64_t frame = frame_find_free(0);
+    while (frame < MAX_PAGES) {
+        uint64_t end = frame_find_used(frame, MAX_PAGES);
+        while (frame < end) {
+            uint32_t order = buddy_fit_order(frame, end - frame);
+            buddy_push(frame, order);
+            frame += 1ULL << order;
         }
+        frame = frame_find_free(end);
     }
-    return 0; // out of memory
 }
 
-void free_frame(uint64_t addr) {
-    uint64_t i = addr / 4096;
-    page_bitmap[i / 8] &= ~(1 << (i % 8));
+// Heap-side wrapper: nothing is lent out until the memory map has been loaded
+static uint64_t grab_frames(size_t count, size_t align) {
+    if (!frames_ready) return 0;
+    return alloc_frames_aligned(count, align);
 }
 
 
-void init_allocator(const struct multiboot_tag_mmap* mmap) {
+static void reserve_logged(const char *what, uint64_t base, uint64_t length) {
+    LOG(LOG_LEVEL_INFO, "reserve: %s %8 - %8", what, base, base + length);
+    reserve_region(base, length);
+}
+
+// Everything live that type-1 mmap entries still cover: low memory, the kernel
+// image (its .bss holds the boot page tables, page_bitmap and the stack), the
+// static heap, the multiboot info itself and whatever it points at.
+static void reserve_boot_regions(const void* mb_info) {
+    // Real-mode IVT/BDA/EBDA and VGA; frame 0 also doubles as the failure value
+    reserve_logged("low memory", 0, 0x100000);
+    reserve_logged("kernel", (uintptr_t)_kernel_start, (uintptr_t)_kernel_end - (uintptr_t)_kernel_start);
+    reserve_logged("static heap", (uintptr_t)_heap_start, HEAP_SIZE);
+    if (!mb_info) return;
+
+    const uint8_t* base = (const uint8_t*)mb_info;
+    const struct mb2_info* info = (const struct mb2_info*)base;
+    reserve_logged("multiboot info", (uintptr_t)base, info->total_size);
+
+    const uint8_t* p   = base + 8;
+    const uint8_t* end = base + info->total_size;
+    while (p + sizeof(struct mb2_tag) <= end) {
+        const struct mb2_tag* tag = (const struct mb2_tag*)p;
+        if (tag->type == 0) break;
+        if (tag->type == 3) {
+            const struct multiboot_tag_module* mod = (const struct multiboot_tag_module*)p;
+            reserve_logged("module", mod->mod_start, mod->mod_end - mod->mod_start);
+        }
+        if (tag->type == 8) { // some firmware puts the linear framebuffer in ordinary RAM
+            const struct mb2_tag_framebuffer* fb = (const struct mb2_tag_framebuffer*)p;
+            reserve_logged("framebuffer", fb->framebuffer_addr,
+                           (uint64_t)fb->framebuffer_pitch * fb->framebuffer_height);
+        }
+        p += (tag->size + 7) & ~7u;
+    }
+}
+
+void init_allocator(const struct multiboot_tag_mmap* mmap, const void* mb_info) {
     size_t count = (mmap->size - sizeof(*mmap)) / mmap->entry_size;
 
+    // Start with every frame used, then free only what the firmware calls RAM.
+    // Holes between mmap entries stay used, so the summary and the frame bits agree.
+    frame_mark(0, MAX_PAGES, 1);
     for (size_t i = 0; i < count; i++) {
         const struct multiboot_mmap_entry* entry = (const void*)mmap->entries + i * mmap->entry_size;
         
+        LOG(LOG_LEVEL_INFO, "mmap: type %8 address %8 length %8",
+            (uint64_t)entry->type, entry->base_addr, entry->length);
         if (entry->type == 1) {
             add_region(entry->base_addr, entry->length);
-            sfprint("type: %8\naddress: %8\nlength: %8\nreserved: %8\n\n", entry->type, entry->base_addr, entry->length, entry->reserved);
-        } else {
-            sfprint("type: %8\naddress: %8\nlength: %8\nreserved: %8\n\n", entry->type, entry->base_addr, entry->length, entry->reserved);
         }
     }
+    reserve_boot_regions(mb_info);
+    buddy_seed();
+    frames_ready = 1;
 }
 
-
-// Prevent name mangling if compiling as C++
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-void* memset(void* bufptr, int value, size_t size) {
-    sfprint("\n\n\n\nmemset called\n\n\n\n");
-    unsigned char* buf = (unsigned char*) bufptr;
-    for (size_t i = 0; i < size; i++) {
-        buf[i] = (unsigned char) value;
-    }
-    return bufptr;
-}
-
-#ifdef __cplusplus
-}
-#endif
-
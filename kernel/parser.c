@@ -6,13 +6,14 @@
 #include "mem.h"
 #include "framebuffer.h"
 #include "fat.h"
+#include "blk.h"
 
 #define MAX_ARGS 64
 #define MAX_CMDS 16
 
-Command **parse_commands(const char *input, int *num_cmds) {
+Command **parse_commands(Arena *arena, const char *input, int *num_cmds) {
     sfprint("parsing commands\n");
-    Command **cmds = cralloc(MAX_CMDS, sizeof(Command *));
+    Command **cmds = arena_calloc(arena, MAX_CMDS, sizeof(Command *));
     if (!cmds) {
         if (num_cmds) *num_cmds = 0;
         return NULL;
@@ -28,16 +29,8 @@ Command **parse_commands(const char *input, int *num_cmds) {
     bool aborted = false;
 
     // Allocate first Command
-    Command *current = cralloc(1, sizeof(Command));
+    Command *current = command_new(arena, MAX_ARGS);
     if (!current) {
-        tfree(cmds);
-        if (num_cmds) *num_cmds = 0;
-        return NULL;
-    }
-    current->argv = cralloc(MAX_ARGS, sizeof(char *));
-    if (!current->argv) {
-        tfree(current);
-        tfree(cmds);
         if (num_cmds) *num_cmds = 0;
         return NULL;
     }
@@ -70,7 +63,7 @@ Command **parse_commands(const char *input, int *num_cmds) {
             if (buff_index > 0) {
                 token_buff[buff_index] = '\0';
                 if (arg_index < MAX_ARGS - 1) {
-                    current->argv[arg_index++] = strdupe(token_buff);
+                    current->argv[arg_index++] = arena_strdup(arena, token_buff);
                     sfprint("\ntoken buffered: %s\n", token_buff);
                 }
                 buff_index = 0;
@@ -90,7 +83,7 @@ Command **parse_commands(const char *input, int *num_cmds) {
         if (buff_index > 0) {
             token_buff[buff_index] = '\0';
             if (arg_index < MAX_ARGS - 1) {
-                current->argv[arg_index++] = strdupe(token_buff);
+                current->argv[arg_index++] = arena_strdup(arena, token_buff);
                 sfprint("\ntoken buffered: %s\n", token_buff);
             }
         }
@@ -99,10 +92,8 @@ Command **parse_commands(const char *input, int *num_cmds) {
 
         if (cmd_index < MAX_CMDS) {
             cmds[cmd_index++] = current;
-        } else {
-            //LOG(LOG_LEVEL_ERR, "Final command exceeds MAX_CMDS, discarding");
-            free_command(current);
         }
+        // else: final command exceeds MAX_CMDS, discarded with the arena
     }
     if (num_cmds) *num_cmds = cmd_index;
     sfprint("returning commands\n");
@@ -111,17 +102,19 @@ Command **parse_commands(const char *input, int *num_cmds) {
 
 
 /*=================================process_input_segments=====================================
-processes expanded input, splitting at semicolons for */
+processes expanded input, splitting at semicolons for. Everything parsed
+for the line lives in shell->cmd_arena and is dropped in one reset at the end */
 void process_input_segments(ShellContext *shell, const char *expanded_input) {
     sfprint("processing input\n");
-    char **segments = split_on_semicolons(expanded_input);
+    Arena *arena = &shell->cmd_arena;
+    char **segments = split_on_semicolons(arena, expanded_input);
     if (!segments) {
         draw_prompt();
         // ends up skipping a line on empty input, instead of 
         // moving to the next line. --shell_line is a bandaid
         // until i can figure out whats happening
         --shell->shell_line;
-        tfree(segments);
+        arena_reset(arena);
         return;
     } 
     Command **cmds;
@@ -129,7 +122,7 @@ void process_input_segments(ShellContext *shell, const char *expanded_input) {
     for (int i = 0; segments[i]; ++i) {
         sfprint("segment %d\n", i);
         num_cmds = 0;
-        cmds = parse_commands(segments[i], &num_cmds);
+        cmds = parse_commands(arena, segments[i], &num_cmds);
         sfprint("parse_commands returned %d command(s)\n", num_cmds + 1);
         for (int a = 0; a < num_cmds; ++a) {
             sfprint("command: %s\n", segments[a]);
@@ -154,7 +147,6 @@ void process_input_segments(ShellContext *shell, const char *expanded_input) {
         }
         if (!valid) {
            // LOG(LOG_LEVEL_WARN, "Skipping invalid command segment: '%s'", segments[i]);
-            free_command_list(cmds, num_cmds);
             continue;
         }
         const char *cmd_name = cmds[0]->argv[0];
@@ -165,8 +157,8 @@ void process_input_segments(ShellContext *shell, const char *expanded_input) {
             draw_prompt();
             fb_draw_string("Quitting", FG, BG);
             shell->running = 0;
-            free_command_list(cmds, num_cmds);
-            free_segments(segments);
+            blk_sync();
+            arena_destroy(arena);
             
             for (int i = 0; i < MAX_HISTORY_LINES; ++i) {
                 if (shell->line_history[i]) {
@@ -183,8 +175,59 @@ void process_input_segments(ShellContext *shell, const char *expanded_input) {
         else if (str_eq(cmd_name, "ls") || str_eq(cmd_name, "LS")) {
             clear_line_no_prompt(shell);
             //shell->shell_line++;
-            fs_list_files(shell);
-            sfprint("Returned from free_command_list\n");
+            if (fs_list_files(shell, cmds[0]->argv[1]) < 0) {
+                fbprintf(shell, "ls: no such directory\n");
+            }
+            sfprint("Returned from fs_list_files\n");
+            break;
+        }
+        else if (str_eq(cmd_name, "cd")) {
+            clear_line_no_prompt(shell);
+            const char *target = cmds[0]->argv[1] ? cmds[0]->argv[1] : "/";
+            if (fat_chdir(shell, target) < 0) {
+                fbprintf(shell, "cd: %s: no such directory\n", target);
+            }
+            break;
+        }
+        else if (str_eq(cmd_name, "pwd")) {
+            clear_line_no_prompt(shell);
+            fbprintf(shell, "%s\n", shell->cwd);
+            break;
+        }
+        else if (str_eq(cmd_name, "sync")) {
+            clear_line_no_prompt(shell);
+            if (blk_sync() < 0) {
+                fbprintf(shell, "sync: write failed\n");
+            }
+            break;
+        }
+        else if (str_eq(cmd_name, "disks")) {
+            clear_line_no_prompt(shell);
+            print_disks(shell);
+            break;
+        }
+        else if (str_eq(cmd_name, "mount")) {
+            clear_line_no_prompt(shell);
+            BlkDev *dev = cmds[0]->argv[1] ? blkdev_find(cmds[0]->argv[1]) : NULL;
+            if (!dev) {
+                fbprintf(shell, "mount: no such device\n");
+            } else if (blk_attach(dev) < 0) {
+                fbprintf(shell, "mount: can't use %s\n", dev->name);
+            } else {
+                // The old path means nothing on the new volume
+                shell->cwd[0] = '/';
+                shell->cwd[1] = '\0';
+            }
+            break;
+        }
+        else if (str_eq(cmd_name, "blkstat")) {
+            clear_line_no_prompt(shell);
+            print_blkstat(shell);
+            break;
+        }
+        else if (str_eq(cmd_name, "memstat")) {
+            clear_line_no_prompt(shell);
+            print_memstat(shell);
             break;
         }
         else if (str_eq(cmd_name, "cat") || str_eq(cmd_name, "CAT")) {            
@@ -223,17 +266,14 @@ void process_input_segments(ShellContext *shell, const char *expanded_input) {
             
         }
     }
-    //sfprint("freeing segments\n");
-    free_segments(segments);
-    //sfprint("Cleared segment, freeing command list\n");
-    free_command_list(cmds, num_cmds);
+    arena_reset(arena);
     clear_line(shell);
     //sfprint("Cleared line\n");
 }
 
 // Note: whitespace trimming deferred to parse_commands()
 // This function only handles quote-aware semicolon splitting
-char **split_on_semicolons(const char *input) {
+char **split_on_semicolons(Arena *arena, const char *input) {
     //sfprint("splitting input\n");
     if (!input) return NULL; // Defensive: null input yields null output
 
@@ -242,16 +282,15 @@ char **split_on_semicolons(const char *input) {
 
     // Make a modifiable copy of the input string — we will insert NULs here
     sfprint("duping %s\n", input);
-    char *copy = strdupe(input);
+    char *copy = arena_strdup(arena, input);
     sfprint("Duped input: %s\n", copy);
     if (!copy) return NULL;
 
     // Allocate space for output segments (+1 for NULL terminator)
     // Worst case: every character is a delimiter, so len+1 segments
-    char **segments = cralloc(len + 2, sizeof(char *));
+    char **segments = arena_calloc(arena, len + 2, sizeof(char *));
     sfprint("Allocing for segments\n");
     if (!segments) {
-        tfree(copy);
         return NULL;
     }
     sfprint("Alloc'd segments\n");
@@ -310,7 +349,7 @@ char **split_on_semicolons(const char *input) {
             if (*start) {
                 // Only store non-empty segments
                 sfprint("\n\n\nDuping segment %d\n", seg_count);
-                segments[seg_count++] = strdupe(start);       
+                segments[seg_count++] = start; // copy is arena-owned, point straight into it
             }
             start = p + 1; // New segment starts after the delimiter
             ++p;
@@ -321,22 +360,13 @@ char **split_on_semicolons(const char *input) {
     }
     // After loop ends, handle the final segment (if non-empty)
     if (*start) {
-        segments[seg_count++] = strdupe(start);
+        segments[seg_count++] = start;
     }
     sfprint("seg count: %8\n", seg_count);
     segments[seg_count] = NULL; // NULL-terminate the array
     for (int i = 0; i < seg_count; ++i) {
         sfprint("segments[%d] : %s\n", i, segments[i]);
     }
-    tfree(copy);
     return segments;
 }
 
-void free_segments(char **segments) {
-    if (!segments) return;
-    for (int i = 0; segments[i]; ++i) {
-        tfree(segments[i]);
-    }
-    tfree(segments);
-}
-
@@ -0,0 +1,104 @@
+#include "pci.h"
+#include "serial.h"
+#include <stddef.h>
+
+static inline void outl(uint16_t port, uint32_t value) {
+    __asm__ volatile ("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t result;
+    __asm__ volatile ("inl %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline uint32_t pci_addr(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off) {
+    return (1u << 31) | ((uint32_t)bus << 16) | ((uint32_t)(dev & 0x1F) << 11) |
+           ((uint32_t)(fn & 0x07) << 8) | (off & 0xFC);
+}
+
+uint32_t pci_read32(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off) {
+    outl(PCI_CONFIG_ADDR, pci_addr(bus, dev, fn, off));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_read16(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off) {
+    return (uint16_t)(pci_read32(bus, dev, fn, off) >> ((off & 2) * 8));
+}
+
+uint8_t pci_read8(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off) {
+    return (uint8_t)(pci_read32(bus, dev, fn, off) >> ((off & 3) * 8));
+}
+
+void pci_write32(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off, uint32_t val) {
+    outl(PCI_CONFIG_ADDR, pci_addr(bus, dev, fn, off));
+    outl(PCI_CONFIG_DATA, val);
+}
+
+void pci_write16(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off, uint16_t val) {
+    uint32_t old = pci_read32(bus, dev, fn, off);
+    uint32_t shift = (off & 2) * 8;
+    old &= ~(0xFFFFu << shift);
+    old |= (uint32_t)val << shift;
+    pci_write32(bus, dev, fn, off, old);
+}
+
+static void pci_fill(uint8_t bus, uint8_t dev, uint8_t fn, PciDevice *out) {
+    uint32_t id = pci_read32(bus, dev, fn, PCI_VENDOR_ID);
+    uint32_t cls = pci_read32(bus, dev, fn, 0x08);
+    out->bus = bus;
+    out->dev = dev;
+    out->fn = fn;
+    out->vendor = (uint16_t)id;
+    out->device = (uint16_t)(id >> 16);
+    out->prog_if = (uint8_t)(cls >> 8);
+    out->subclass = (uint8_t)(cls >> 16);
+    out->class_code = (uint8_t)(cls >> 24);
+}
+
+// Brute-force scan of all 256 buses. Calls fn for each function present and
+// stops early when it returns nonzero.
+static int pci_scan(int (*visit)(const PciDevice *d, void *ctx), void *ctx) {
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t dev = 0; dev < 32; dev++) {
+            if (pci_read16(bus, dev, 0, PCI_VENDOR_ID) == 0xFFFF) continue;
+            uint8_t fns = (pci_read8(bus, dev, 0, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+            for (uint8_t fn = 0; fn < fns; fn++) {
+                if (pci_read16(bus, dev, fn, PCI_VENDOR_ID) == 0xFFFF) continue;
+                PciDevice d;
+                pci_fill(bus, dev, fn, &d);
+                if (visit(&d, ctx)) return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    uint8_t class_code;
+    uint8_t subclass;
+    PciDevice *out;
+} PciMatch;
+
+static int pci_match_class(const PciDevice *d, void *ctx) {
+    PciMatch *m = ctx;
+    if (d->class_code != m->class_code || d->subclass != m->subclass) return 0;
+    *m->out = *d;
+    return 1;
+}
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, PciDevice *out) {
+    PciMatch m = { class_code, subclass, out };
+    return pci_scan(pci_match_class, &m);
+}
+
+static int pci_log_device(const PciDevice *d, void *ctx) {
+    (void)ctx;
+    LOG(LOG_LEVEL_INFO, "pci %d:%d.%d %x:%x class %h/%h if %h",
+        d->bus, d->dev, d->fn, d->vendor, d->device, d->class_code, d->subclass, d->prog_if);
+    return 0;
+}
+
+void pci_enumerate(void) {
+    pci_scan(pci_log_device, NULL);
+}
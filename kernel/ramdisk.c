@@ -0,0 +1,42 @@
+#include "ramdisk.h"
+#include "blkdev.h"
+#include "serial.h"
+#include "string.h"
+
+#define RAMDISK_SECTOR_SIZE 512
+
+static BlkDev ram_devs[RAMDISK_MAX];
+static int ram_count = 0;
+
+static inline uint8_t *ram_sector(BlkDev *dev, uint64_t lba) {
+    return (uint8_t*)dev->priv + lba * RAMDISK_SECTOR_SIZE;
+}
+
+static int ram_read(BlkDev *dev, uint64_t lba, uint32_t count, uint8_t *buf) {
+    memcpy(buf, ram_sector(dev, lba), (size_t)count * RAMDISK_SECTOR_SIZE);
+    return 0;
+}
+
+static int ram_write(BlkDev *dev, uint64_t lba, uint32_t count, const uint8_t *buf) {
+    memcpy(ram_sector(dev, lba), buf, (size_t)count * RAMDISK_SECTOR_SIZE);
+    return 0;
+}
+
+static const BlkDevOps ram_ops = { ram_read, ram_write, NULL };
+
+int ramdisk_add_module(const struct multiboot_tag_module *mod) {
+    uint64_t bytes = mod->mod_end - mod->mod_start;
+    if (ram_count == RAMDISK_MAX || bytes < RAMDISK_SECTOR_SIZE) {
+        LOG(LOG_LEVEL_WARN, "ramdisk: skipping module at %8 (%8 bytes)", (uint64_t)mod->mod_start, bytes);
+        return -1;
+    }
+    BlkDev *dev = &ram_devs[ram_count];
+    blkdev_name(dev, "ram", ram_count);
+    dev->ops = &ram_ops;
+    dev->sector_size = RAMDISK_SECTOR_SIZE;
+    dev->sectors = bytes / RAMDISK_SECTOR_SIZE;   // a trailing partial sector is ignored
+    dev->priv = (void*)(uintptr_t)mod->mod_start;
+    if (blkdev_register(dev) < 0) return -1;
+    ram_count++;
+    return 0;
+}
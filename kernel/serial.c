@@ -173,3 +173,15 @@ void sfprint(const char* str, ...) {
     format_sfprint(str, args);
     va_end(args);
 }
+
+void log_write(int level, const char* fmt, ...) {
+    static const char* const tags[] = { "", "E: ", "W: ", "I: ", "D: ", "T: " };
+    if (level > 0 && level <= LOG_LEVEL_TRACE) {
+        serial_write(tags[level]);
+    }
+    va_list args;
+    va_start(args, fmt);
+    format_sfprint(fmt, args);
+    va_end(args);
+    serial_write_char('\n');
+}
@@ -9,6 +9,7 @@
 #include "fat.h"
 #include "parser.h"
 #include "assertf.h"
+#include "blk.h"
 #include <stddef.h>
 
 #define PROMPT_LEN 8
@@ -100,6 +101,9 @@ void init_shell_lines(ShellContext *shell) {
     sfprint("scroll offset: %d\n", shell->scroll_offset);
     shell->history_count = 0;
     sfprint("History count: %d\n", shell->history_count);
+    arena_init(&shell->cmd_arena);
+    shell->cwd[0] = '/';
+    shell->cwd[1] = '\0';
     shell->line_history = cralloc(MAX_HISTORY_LINES, sizeof(char*));
     assertf(shell->line_history != NULL);
 
@@ -161,26 +165,15 @@ void scroll_screen_up(ShellContext *shell) {
     //sfprint("max_lines: %d\n", max_lines);
     //sfprint("cursor.y: %d\n", fb_cursor.y);
     if (shell->shell_line >= max_lines) {
-        uint32_t* fb = (uint32_t*)(uintptr_t)framebuffer.addr;
-        int pixels_per_row = framebuffer.pitch / 4;
-        int total_rows = framebuffer.height;
-
-        // Scroll each pixel row up by one
-        for (int row = 0; row < total_rows - FONT_HEIGHT; row++) {
-            uint32_t* dest = fb + row * pixels_per_row;
-            uint32_t* src  = fb + (row + FONT_HEIGHT) * pixels_per_row;
-            for (int x = 0; x < pixels_per_row; x++) {
-                dest[x] = src[x];
-            }
-        }
+        uint8_t* fb = (uint8_t*)(uintptr_t)framebuffer.addr;
+        size_t band = (size_t)framebuffer.pitch * FONT_HEIGHT;
+        size_t total = (size_t)framebuffer.pitch * framebuffer.height;
+
+        // Scroll every pixel row up by one text line in a single move
+        memmove(fb, fb + band, total - band);
 
         // Clear bottom FONT_HEIGHT rows
-        for (int row = total_rows - FONT_HEIGHT; row < total_rows; row++) {
-            uint32_t* dest = fb + row * pixels_per_row;
-            for (int x = 0; x < pixels_per_row; x++) {
-                dest[x] = 0x00000000;
-            }
-        }
+        memset(fb + total - band, 0, band);
         shell->shell_line = max_lines - 1;
     }
 }
@@ -296,4 +289,48 @@ void shift_left(char* buf, size_t pos, size_t len) {
         buf[i] = buf[i + 1];
     }
     buf[len - 1] = '\0';
-}
\ No newline at end of file
+}
+
+int print_memstat(ShellContext *shell) {
+    HeapStats hs;
+    mem_heap_stats(&hs);
+    fbprintf(shell, "heap: %8 chunk + %8 slab bytes in use, %8 frames\n",
+             hs.chunk_bytes, hs.slab_bytes, hs.heap_frames);
+    fbprintf(shell, "free: %8 bytes in %8 chunks, largest %8\n",
+             hs.free_bytes, hs.free_chunks, hs.largest_free);
+#if MEM_PROFILE
+    AllocSite top[8];
+    int n = mem_top_sites(top, 8);
+    fbprintf(shell, "site      live      peak      allocs    frees     slack\n");
+    for (int i = 0; i < n; i++) {
+        fbprintf(shell, "%x  %8  %8  %8  %8  %8\n", (uint32_t)(uintptr_t)top[i].site,
+                 top[i].live_bytes, top[i].peak_bytes,
+                 (uint64_t)top[i].allocs, (uint64_t)top[i].frees, top[i].slack_bytes);
+    }
+#else
+    fbprintf(shell, "site profiling off (build with MEM_PROFILE=1)\n");
+#endif
+    return 0;
+}
+
+int print_blkstat(ShellContext *shell) {
+    BlkStats bs;
+    blk_stats(&bs);
+    uint64_t total = bs.hits + bs.misses;
+    uint64_t pct = total ? bs.hits * 100 / total : 0;
+    fbprintf(shell, "cache: %8 hits, %8 misses (%8%% hit), %8 disk reads\n",
+             bs.hits, bs.misses, pct, bs.commands);
+    fbprintf(shell, "cache: %8 sectors read ahead\n", bs.readahead);
+    fbprintf(shell, "cache: %8 of %8 sectors in use\n", (uint64_t)bs.cached, (uint64_t)bs.capacity);
+    return 0;
+}
+
+int print_disks(ShellContext *shell) {
+    BlkDev *cur = blk_device();
+    for (int i = 0; i < blkdev_count(); i++) {
+        BlkDev *dev = blkdev_get(i);
+        fbprintf(shell, "%c %s  %8 sectors of %d bytes\n", dev == cur ? '*' : ' ',
+                 dev->name, dev->sectors, (int)dev->sector_size);
+    }
+    return 0;
+}
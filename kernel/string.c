@@ -16,7 +16,7 @@ int cst_strcmp(char *str1, char *str2) {
     char *p2 = str2;  
     int cnt  = 0;
     while (*p1) {
-      sfprint("p1[%8] = %c  p2[%8] = %c\n", cnt, *p1, cnt, *p2);  
+      LOG(LOG_LEVEL_TRACE, "p1[%d] = %c  p2[%d] = %c", cnt, *p1, cnt, *p2);
       if (*p1 != *p2) {
             return 0;
         } else {
@@ -48,15 +48,183 @@ int custom_strlen(char *s) {
 
 char* strdupe(const char* str) {
     size_t len = custom_strlen(str);
-    char* dup = thralloc(len + 1); // or thrcalloc(len + 1, sizeof(char)) for zeroed
+    char* dup = thralloc_at(len + 1, __builtin_return_address(0)); // charge the copy to our caller
     if (!dup) return NULL;
 
-    for (size_t i = 0; i < len; i++) {
-        dup[i] = str[i];
+    memcpy(dup, str, len + 1);
+    return dup;
+}
+
+/////// BLOCK MEMORY OPS ////////////////////////////////////////
+// Short copies (< MEM_SMALL) just use rep movsb. That's a few dozen cycles of
+// startup, which is fine at these sizes, and the compiler can't turn it back
+// into a memcpy call. Past that, CPUs with ERMS (CPUID.7:EBX[9]) run rep
+// movsb/stosb at full line speed. Without ERMS we use an SSE2 loop with
+// aligned stores, or rep movsq/stosq if string_init hasn't run yet.
+// SSE is switched on in entry.asm, and isr.asm saves XMM state around handlers.
+
+#define MEM_SMALL 64
+#define MEM_WIDE  256
+
+// Don't let -O2 turn the fallback loops below back into calls to ourselves
+#define NO_LIBCALL __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+typedef long long v2di   __attribute__((vector_size(16), may_alias));
+typedef long long v2di_u __attribute__((vector_size(16), may_alias, aligned(1)));
+typedef char      v16qi_u __attribute__((vector_size(16), may_alias, aligned(1)));
+
+static uint8_t have_erms = 0;
+static uint8_t have_sse2 = 0;
+
+static inline void cpuid(uint32_t leaf, uint32_t sub, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile ("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(sub));
+}
+
+void string_init(void) {
+    uint32_t a, b, c, d;
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+
+    cpuid(1, 0, &a, &b, &c, &d);
+    have_sse2 = (d >> 26) & 1;
+    if (max_leaf >= 7) {
+        cpuid(7, 0, &a, &b, &c, &d);
+        have_erms = (b >> 9) & 1;
     }
-    dup[len] = '\0';
+    LOG(LOG_LEVEL_INFO, "string_init: erms=%d sse2=%d", have_erms, have_sse2);
+}
 
-    return dup;
+static inline void movsb(void *dest, const void *src, size_t n) {
+    __asm__ volatile ("rep movsb" : "+D"(dest), "+S"(src), "+c"(n) : : "memory");
+}
+
+static inline void stosb(void *dest, uint8_t v, size_t n) {
+    __asm__ volatile ("rep stosb" : "+D"(dest), "+c"(n) : "a"(v) : "memory");
+}
+
+// Forward copy, also safe for overlap when dest < src: every chunk is loaded
+// before the stores that could reach it.
+static NO_LIBCALL void copy_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+    if (n < MEM_SMALL || have_erms) {
+        movsb(d, s, n);
+        return;
+    }
+    if (have_sse2 && n >= MEM_WIDE) {
+        size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+        movsb(d, s, head);
+        d += head;
+        s += head;
+        n -= head;
+        for (; n >= 64; n -= 64, d += 64, s += 64) {
+            v2di x0 = ((const v2di_u *)s)[0];
+            v2di x1 = ((const v2di_u *)s)[1];
+            v2di x2 = ((const v2di_u *)s)[2];
+            v2di x3 = ((const v2di_u *)s)[3];
+            ((v2di *)d)[0] = x0;
+            ((v2di *)d)[1] = x1;
+            ((v2di *)d)[2] = x2;
+            ((v2di *)d)[3] = x3;
+        }
+        movsb(d, s, n);
+        return;
+    }
+    size_t q = n >> 3;
+    __asm__ volatile ("rep movsq" : "+D"(d), "+S"(s), "+c"(q) : : "memory");
+    movsb(d, s, n & 7);
+}
+
+void* memcpy(void* dest, const void* src, size_t n) {
+    copy_fwd(dest, src, n);
+    return dest;
+}
+
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    if (d == s || n == 0) return dest;
+    if (d < s || d >= s + n) {
+        copy_fwd(d, s, n);
+        return dest;
+    }
+    // dest overlaps the tail of src: copy top-down, qwords first, then the
+    // leftover head bytes. DF must be clear again before we return.
+    size_t q = n >> 3;
+    size_t rem = n & 7;
+    const uint8_t *sq = s + n - 8;
+    uint8_t *dq = d + n - 8;
+    const uint8_t *sb = s + rem - 1;
+    uint8_t *db = d + rem - 1;
+    __asm__ volatile ("std\n\t"
+                      "rep movsq\n\t"
+                      "mov %[sb], %%rsi\n\t"
+                      "mov %[db], %%rdi\n\t"
+                      "mov %[rem], %%rcx\n\t"
+                      "rep movsb\n\t"
+                      "cld"
+                      : "+D"(dq), "+S"(sq), "+c"(q)
+                      : [sb] "r"(sb), [db] "r"(db), [rem] "r"(rem)
+                      : "memory");
+    return dest;
+}
+
+void* NO_LIBCALL memset(void* bufptr, int value, size_t size) {
+    uint8_t *d = bufptr;
+    uint8_t v = (uint8_t)value;
+    if (size < MEM_SMALL || have_erms) {
+        stosb(d, v, size);
+        return bufptr;
+    }
+    uint64_t pat = v * 0x0101010101010101ULL;
+    if (have_sse2 && size >= MEM_WIDE) {
+        size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+        stosb(d, v, head);
+        d += head;
+        size -= head;
+        v2di x = { (long long)pat, (long long)pat };
+        for (; size >= 64; size -= 64, d += 64) {
+            ((v2di *)d)[0] = x;
+            ((v2di *)d)[1] = x;
+            ((v2di *)d)[2] = x;
+            ((v2di *)d)[3] = x;
+        }
+        stosb(d, v, size);
+        return bufptr;
+    }
+    size_t q = size >> 3;
+    __asm__ volatile ("rep stosq" : "+D"(d), "+c"(q) : "a"(pat) : "memory");
+    stosb(d, v, size & 7);
+    return bufptr;
+}
+
+int memcmp(const void* a, const void* b, size_t n) {
+    const uint8_t *p = a;
+    const uint8_t *q = b;
+    // 16 bytes per step: pcmpeqb + pmovmskb, then the first differing byte
+    // comes from the lowest clear bit of the mask.
+    if (have_sse2) {
+        for (; n >= 16; n -= 16, p += 16, q += 16) {
+            v16qi_u x = *(const v16qi_u *)p;
+            v16qi_u y = *(const v16qi_u *)q;
+            unsigned mask = (unsigned)__builtin_ia32_pmovmskb128(__builtin_ia32_pcmpeqb128(x, y));
+            if (mask != 0xFFFF) {
+                unsigned i = __builtin_ctz(~mask);
+                return (int)p[i] - (int)q[i];
+            }
+        }
+    }
+    for (; n >= 8; n -= 8, p += 8, q += 8) {
+        uint64_t x, y;
+        __builtin_memcpy(&x, p, 8);
+        __builtin_memcpy(&y, q, 8);
+        if (x != y) {
+            unsigned i = __builtin_ctzll(x ^ y) >> 3;
+            return (int)p[i] - (int)q[i];
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] != q[i]) return (int)p[i] - (int)q[i];
+    }
+    return 0;
 }
 
 